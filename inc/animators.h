@@ -0,0 +1,75 @@
+#pragma once
+
+#include "opengl.h"
+
+// update_animators tests this many entries at once. Group columns are padded
+// to a multiple of it so there's never a partial block.
+#define ANIM_LANES 8
+
+#define NO_ANIMATOR 0xffffffffu
+
+// Every entry is in exactly one group, and moves between them as its block's
+// animations start and finish. Collected entries are dropped when done.
+enum anim_group {
+	ANIM_IDLE,
+	ANIM_MOVING,
+	ANIM_FALLING,
+	ANIM_REBOUND,
+	ANIM_COLLECTING,
+	ANIM_NUM_GROUPS,
+};
+
+enum anim_column {
+	// Where the block ends up.
+	ANIM_X, ANIM_Y, ANIM_Z,
+	// As for struct motion_params.
+	ANIM_FROM_X, ANIM_FROM_Y, ANIM_FROM_Z,
+	ANIM_START_TIME, ANIM_DURATION, ANIM_END_TIME,
+	ANIM_MAG_X,  ANIM_MAG_Y,  ANIM_MAG_Z,
+	ANIM_OFF_X,  ANIM_OFF_Y,  ANIM_OFF_Z,
+	ANIM_FREQ_X, ANIM_FREQ_Y, ANIM_FREQ_Z,
+	ANIM_NUM_COLUMNS,
+};
+
+struct anim_group_entries {
+	u32 count;
+	u32 *block_id;
+	// The cube or item instance drawing the block.
+	u32 *instance;
+	u8 *is_char;
+	f32 *columns[ANIM_NUM_COLUMNS];
+};
+
+struct animators {
+	u32 capacity;
+	struct anim_group_entries groups[ANIM_NUM_GROUPS];
+	// Group in the top byte and index below it, or NO_ANIMATOR, by block id.
+	u32 *slots;
+};
+
+// Block ids must be below capacity, which also bounds every group.
+i32 init_animators(struct animators *anims, u32 capacity);
+void free_animators(struct animators *anims);
+void reset_animators(struct animators *anims);
+
+void add_animator(struct animators *anims, u32 block_id, u32 instance,
+	u8 is_char, f32 x, f32 y, f32 z, struct idle_params idle);
+
+struct anim_entry {
+	u32 instance;
+	u8 is_char;
+	f32 x, y, z;
+};
+
+// Moves the block's entry into group, running from start_time for duration.
+// Moves and falls start where the block is and end at (x, y, z); rebounds are
+// in direction (x, y, z) and collecting ignores it. Fills in the entry and
+// returns the motion its instance should be given.
+struct motion_params start_animator(struct animators *anims, u32 block_id,
+	enum anim_group group, f32 start_time, f32 duration,
+	f32 x, f32 y, f32 z, struct anim_entry *entry_out);
+
+// Moves entries whose motion has finished by time back to idle, or drops
+// them when collected. Returns how many are still in motion and adds the
+// number of falls that landed to *num_landed.
+u32 update_animators(struct animators *anims, f32 time, u32 *num_landed);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "files.h"
+
+// An asset archive is a little-endian header, a table of contents and then
+// each asset's bytes, starting on an ARCHIVE_ALIGN boundary:
+//    0  "LDPK"
+//    4  u16 version
+//    6  u16 number of entries
+//    8  u32 FNV-1a of the table of contents
+//   12  4 bytes of padding
+// and for each entry, from offset 16:
+//    0  name, NUL padded to ARCHIVE_NAME_SIZE bytes
+//   32  u64 offset of the asset from the start of the file
+//   40  u32 size
+//   44  u32 FNV-1a of the asset
+#define ARCHIVE_HEADER_SIZE 16
+#define ARCHIVE_ENTRY_SIZE  48
+#define ARCHIVE_NAME_SIZE   32
+#define ARCHIVE_ALIGN       16
+#define ARCHIVE_VERSION     1
+
+struct archive {
+	struct mapped_file file;
+	u32 num_entries;
+	const u8 *toc;
+};
+
+enum archive_error {
+	ARCHIVE_OK,
+	ARCHIVE_TRUNCATED,
+	ARCHIVE_BAD_MAGIC,
+	ARCHIVE_BAD_VERSION,
+	ARCHIVE_BAD_CHECKSUM,
+	ARCHIVE_BAD_NAME,
+	ARCHIVE_NOT_FOUND,
+};
+
+// Maps the archive and checks its table of contents. Returns
+// ARCHIVE_NOT_FOUND, with errno set, if it can't be opened.
+enum archive_error open_archive(const char *path, struct archive *archive);
+void close_archive(struct archive *archive);
+
+// Points *data at the named asset inside the mapping, after checking it
+// against its checksum. Safe to call from several threads at once.
+enum archive_error find_asset(const struct archive *archive,
+	const char *name, const u8 **data, u64 *size);
+
+// Writes an archive of the given assets, named by the last part of each
+// path. Returns non-zero if a name is too long or a write fails.
+i32 write_archive(FILE *out, u32 num_assets, const char *const *paths,
+	const struct mapped_file *assets);
+
+const char *archive_error_string(enum archive_error error);
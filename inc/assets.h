@@ -0,0 +1,26 @@
+#pragma once
+
+#include "files.h"
+
+// The game's assets come from assets.pak beside the binary when there is
+// one, and from loose files there otherwise.
+struct asset {
+	const u8 *data;
+	u64 size;
+	// Only mapped for a loose file.
+	struct mapped_file file;
+};
+
+// Returns non-zero if there's an archive but it's damaged.
+i32 open_assets(void);
+// Any asset still in use from the archive goes with it.
+void close_assets(void);
+
+// The path of a file beside the binary, to be freed with free. Returns NULL,
+// having logged why, if there's no memory or base path.
+char *asset_path(const char *name);
+
+// Safe from any thread between open_assets and close_assets. Logs why and
+// returns non-zero if the asset can't be read.
+i32 load_asset(const char *name, struct asset *asset);
+void free_asset(struct asset *asset);
@@ -8,6 +8,13 @@ enum sound {
 	SOUND_VICTORY,
 };
 
+// Starts decoding the sounds on a worker thread once the mixer is open.
+// init_audio waits for it.
+void start_loading_audio(void);
+// Waits for the worker and frees what it decoded, for when init_audio won't
+// be called.
+void cancel_loading_audio(void);
+
 i32 init_audio(void);
 void quit_audio(void);
 
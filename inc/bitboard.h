@@ -0,0 +1,80 @@
+#pragma once
+
+#include "game.h"
+
+// Bitboards cover the level plus this many cells either side of it in x and
+// z, so that cubes pushed off the edge are still tracked.
+#define BITS_MARGIN      2
+#define BITS_MAX_WIDTH   (MAX_LEVEL_WIDTH  + 2 * BITS_MARGIN)
+#define BITS_MAX_HEIGHT  (MAX_LEVEL_HEIGHT + 2 * BITS_MARGIN)
+#define BITS_LAYER_WORDS ((BITS_MAX_WIDTH * BITS_MAX_HEIGHT + 63) / 64)
+// Level strings only have grey cubes and three colours.
+#define BITS_MAX_COLORS  4
+
+// Returned by play_move_bits when a block would leave the box the bitboards
+// cover. The state is left as it was and the move has to be played on a
+// struct level instead.
+#define BITS_MOVE_OUT_OF_BOX (1 << 8)
+
+// One bit per cell of a layer: cell (x, z) of the level is bit
+// (z + BITS_MARGIN) * width + x + BITS_MARGIN, with width the box width.
+struct layer_bits {
+	u64 words[BITS_LAYER_WORDS];
+};
+
+// The parts of a level that never change. Grey cubes can't be pushed and
+// never fall, so one copy is shared read-only by every state of a level.
+struct level_bits_static {
+	u32 width, height, layers;
+	u32 num_words;
+	u32 num_colors;
+	struct layer_bits grey[MAX_LEVEL_LAYERS];
+	struct layer_bits in_box, not_first_column, not_last_column;
+};
+
+// Per-layer boards of a state. Cube and heart boards are indexed by colour;
+// grey cubes never change so are only in the statics.
+enum bits_board {
+	// Cells that block movement: grey cubes, coloured cubes and the player.
+	BITS_BOARD_SOLID,
+	BITS_BOARD_GOALS,
+	BITS_BOARD_CUBES,
+	BITS_BOARD_HEARTS = BITS_BOARD_CUBES + BITS_MAX_COLORS,
+	BITS_NUM_BOARDS   = BITS_BOARD_HEARTS + BITS_MAX_COLORS,
+};
+
+struct level_bits {
+	const struct level_bits_static *statics;
+	struct {
+		i8 x, y, z;
+	} player;
+	u8 player_health[BITS_MAX_COLORS];
+	// Board b of layer y is the num_words words at (b * layers + y) *
+	// num_words, so only the front of words is live and copy_level_bits()
+	// copies nothing past it.
+	u64 words[BITS_NUM_BOARDS * MAX_LEVEL_LAYERS * BITS_LAYER_WORDS];
+};
+
+static inline u64 *bits_board(struct level_bits *bits, u32 board, u32 y) {
+	const struct level_bits_static *st = bits->statics;
+	return &bits->words[(board * st->layers + y) * st->num_words];
+}
+
+// Both return non-zero when the level can't be represented: too many
+// colours, or blocks outside the box.
+i32 build_level_bits_static(struct level_bits_static *statics,
+	struct level *level);
+i32 build_level_bits(struct level_bits *bits,
+	const struct level_bits_static *statics, struct level *level);
+void copy_level_bits(struct level_bits *dst, struct level_bits *src);
+
+// Plays a move with the same rules as play_move_fast and returns the same
+// enum move_result mask, or BITS_MOVE_OUT_OF_BOX. Cells holding a solid
+// block and an item are treated as solid; play_move answers by block order.
+// check_moves -b plays random games on every pack level both ways and
+// compares the states.
+u32 play_move_bits(struct level_bits *bits, enum move move);
+
+// Cells on the player's layer the player can walk to without pushing,
+// falling or collecting anything.
+void player_reachable_bits(struct level_bits *bits, struct layer_bits *out);
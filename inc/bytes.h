@@ -0,0 +1,43 @@
+#pragma once
+
+// Little-endian encoding and FNV-1a hashing for the file formats, so none of
+// them depend on padding or on the host's byte order.
+
+#define FNV_OFFSET_32 0x811c9dc5u
+#define FNV_PRIME_32  0x01000193u
+#define FNV_OFFSET_64 0xcbf29ce484222325ull
+#define FNV_PRIME_64  0x00000100000001b3ull
+
+inline static u32 fnv32(u32 hash, const u8 *data, u64 size) {
+	for (u64 i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * FNV_PRIME_32;
+	}
+	return hash;
+}
+
+inline static void put_u16(u8 *p, u16 x) {
+	p[0] = x;
+	p[1] = x >> 8;
+}
+
+inline static void put_u32(u8 *p, u32 x) {
+	put_u16(p, x);
+	put_u16(p + 2, x >> 16);
+}
+
+inline static void put_u64(u8 *p, u64 x) {
+	put_u32(p, x);
+	put_u32(p + 4, x >> 32);
+}
+
+inline static u16 get_u16(const u8 *p) {
+	return p[0] | (p[1] << 8);
+}
+
+inline static u32 get_u32(const u8 *p) {
+	return get_u16(p) | ((u32)get_u16(p + 2) << 16);
+}
+
+inline static u64 get_u64(const u8 *p) {
+	return get_u32(p) | ((u64)get_u32(p + 4) << 32);
+}
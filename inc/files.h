@@ -0,0 +1,12 @@
+#pragma once
+
+// A read-only view of a whole file, mapped rather than copied.
+struct mapped_file {
+	const u8 *data;
+	u64 size;
+};
+
+// Returns non-zero, with errno set, if the file can't be opened or mapped.
+// An empty file maps to no data and a size of 0.
+i32 map_file(const char *path, struct mapped_file *file);
+void unmap_file(struct mapped_file *file);
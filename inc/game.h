@@ -8,9 +8,10 @@ enum block_type {
 	BLOCK_TYPE_GOAL,
 };
 
+// Blocks are packed into 8 bytes so that copying a level stays cheap.
 struct block {
-	enum block_type type;
-	u32 block_id;
+	u16 block_id;
+	u8 type; // enum block_type
 	struct {
 		i8 x, y, z;
 	} pos;
@@ -24,14 +25,31 @@ struct block {
 	};
 };
 
+// Grid cells hold the slot in level->blocks of the block occupying them, 0
+// for an empty cell (slot 0 is always the empty block), or GRID_SHARED when
+// several blocks have ended up in the same cell, in which case lookups fall
+// back to scanning the blocks.
+#define GRID_SHARED 0xffff
+
 struct level {
 	u32 width, height, layers;
 	u32 num_blocks;
-	struct block blocks[MAX_BLOCKS];
+	u16 num_block_ids;
+	// Slot in blocks of the player.
+	u16 player_slot;
+	u32 num_offgrid_blocks;
+	struct camera_params camera;
 	struct color background_color, player_color, goal_color;
 	u32 num_colors;
 	struct color color_map[MAX_COLORS];
 	u8 player_health[MAX_COLORS];
+	// Only the first width*height*layers cells of grid, num_block_ids
+	// entries of block_slots and num_blocks entries of blocks are live, and
+	// copy_level() copies nothing past them.
+	u16 grid[MAX_LEVEL_LAYERS * MAX_LEVEL_HEIGHT * MAX_LEVEL_WIDTH];
+	// Slot in blocks of each block_id.
+	u16 block_slots[MAX_BLOCKS];
+	struct block blocks[MAX_BLOCKS];
 };
 
 enum move {
@@ -84,9 +102,25 @@ struct event {
 };
 
 void reset_level(struct level *level);
+void copy_level(struct level *dst, struct level *src);
+void move_block_by_id(struct level *level, u32 block_id, i8 x, i8 y, i8 z);
+void delete_block_by_id(struct level *level, u32 block_id);
+// Adds a block under the next free block id, as build_level_from_strings
+// does for each one it reads.
+void add_block(struct level *level, struct block block);
 void build_level_from_strings(struct level *level, char **strings);
+enum move_result {
+	MOVE_RESULT_MOVED          = 1 << 0,
+	MOVE_RESULT_WON            = 1 << 1,
+	MOVE_RESULT_DIED           = 1 << 2,
+	MOVE_RESULT_HEALTH_CHANGED = 1 << 3,
+};
+
 void play_move(
 	struct level *level,
 	u32 *num_events_out,
 	struct event *events_out,
 	enum move move);
+// Applies the same rules as play_move without building any events, and
+// returns a mask of enum move_result bits describing what happened.
+u32 play_move_fast(struct level *level, enum move move);
@@ -3,6 +3,8 @@
 #include <SDL.h>
 
 #include "game.h"
+#include "levels.h"
+#include "replay.h"
 
 enum outcome {
 	OUTCOME_DEATH,
@@ -10,4 +12,19 @@ enum outcome {
 	OUTCOME_QUIT,
 };
 
-enum outcome run_game_ui(SDL_Window *window, struct level *level);
+i32 init_game_ui(void);
+void quit_game_ui(void);
+
+// Builds the level, draws its animations from a fresh seed and bakes its
+// static cubes on a worker thread. run_game_ui starts the next level, or the
+// retry, as its fade out begins. Never waits: while one level is being
+// prepared, asking for another does nothing and wait_for_level sorts it out.
+void prepare_level(u32 level_num);
+// Waits for the level to be prepared, or prepares it here if it wasn't, and
+// makes it the one run_game_ui plays. Returns the seed it was prepared with
+// through seed.
+enum level_pack_error wait_for_level(u32 level_num, u32 *seed);
+
+// Plays the level from wait_for_level. Moves played are recorded into replay
+// unless it is NULL.
+enum outcome run_game_ui(SDL_Window *window, struct replay *replay);
@@ -16,6 +16,8 @@ typedef f32  GLclampf;
 typedef f64  GLdouble;
 typedef f64  GLclampd;
 typedef char GLchar;
+typedef u64  GLuint64;
+typedef struct __GLsync *GLsync;
 
 #ifdef _WIN64
 typedef i64 GLsizeiptr;
@@ -49,6 +51,17 @@ typedef i32 GLintptr;
 #define GL_DYNAMIC_READ         0x88E9
 #define GL_DYNAMIC_COPY         0x88EA
 
+#define GL_MAP_WRITE_BIT              0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT   0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT     0x0020
+
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT    0x00000001
+#define GL_ALREADY_SIGNALED           0x911A
+#define GL_TIMEOUT_EXPIRED            0x911B
+#define GL_CONDITION_SATISFIED        0x911C
+#define GL_WAIT_FAILED                0x911D
+
 #define GL_BYTE           0x1400
 #define GL_UNSIGNED_BYTE  0x1401
 #define GL_SHORT          0x1402
@@ -56,6 +69,7 @@ typedef i32 GLintptr;
 #define GL_INT            0x1404
 #define GL_UNSIGNED_INT   0x1405
 #define GL_FLOAT          0x1406
+#define GL_HALF_FLOAT     0x140B
 #define GL_2_BYTES        0x1407
 #define GL_3_BYTES        0x1408
 #define GL_4_BYTES        0x1409
@@ -77,12 +91,23 @@ typedef i32 GLintptr;
 #define GL_TEXTURE_2D         0x0DE1
 #define GL_RGBA32F            0x8814
 #define GL_RGBA               0x1908
+#define GL_RED                0x1903
+#define GL_R8                 0x8229
+#define GL_UNPACK_ALIGNMENT   0x0CF5
 #define GL_TEXTURE0           0x84C0
 #define GL_TEXTURE1           0x84C1
 #define GL_TEXTURE_MAG_FILTER 0x2800
 #define GL_TEXTURE_MIN_FILTER 0x2801
 #define GL_NEAREST            0x2600
 
+#define GL_VENDOR   0x1F00
+#define GL_RENDERER 0x1F01
+#define GL_VERSION  0x1F02
+
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+
 #define GL_3_3_FUNCTIONS \
 	/* begin function list */ \
 	GL_FUNC(void,   glClear,            GLbitfield mask) \
@@ -103,6 +128,7 @@ typedef i32 GLintptr;
 	GL_FUNC(void,   glUseProgram,       GLuint program) \
 	GL_FUNC(GLint,  glGetUniformLocation, GLuint program, const GLchar *name) \
 	GL_FUNC(void,   glUniform1i,        GLint location, GLint v0) \
+	GL_FUNC(void,   glUniform1f,        GLint location, GLfloat v0) \
 	GL_FUNC(void,   glUniform2f,        GLint location, GLfloat v0, GLfloat v1) \
 	GL_FUNC(void,   glUniform3f,        GLint location, GLfloat v0, GLfloat v1, GLfloat v2) \
 	GL_FUNC(void,   glUniform4f,        GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) \
@@ -112,6 +138,11 @@ typedef i32 GLintptr;
 	GL_FUNC(void,   glBindBuffer,       GLenum target, GLuint buffer) \
 	GL_FUNC(void,   glBufferData,       GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) \
 	GL_FUNC(void,   glBufferSubData,    GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) \
+	GL_FUNC(void *, glMapBufferRange,   GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) \
+	GL_FUNC(GLboolean, glUnmapBuffer,   GLenum target) \
+	GL_FUNC(GLsync, glFenceSync,        GLenum condition, GLbitfield flags) \
+	GL_FUNC(GLenum, glClientWaitSync,   GLsync sync, GLbitfield flags, GLuint64 timeout) \
+	GL_FUNC(void,   glDeleteSync,       GLsync sync) \
 	GL_FUNC(void,   glGenVertexArrays,  GLsizei n, GLuint *arrays) \
 	GL_FUNC(void,   glDeleteVertexArrays, GLsizei n, GLuint *arrays) \
 	GL_FUNC(void,   glBindVertexArray,  GLuint array) \
@@ -136,11 +167,25 @@ typedef i32 GLintptr;
 	GL_FUNC(void,   glTexImage2D,       GLenum target, GLint level, GLint internalFormat, GLsizei width, \
 		GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *data) \
 	GL_FUNC(void,   glTexParameteri,    GLenum target, GLenum pname, GLint param) \
+	GL_FUNC(void,   glPixelStorei,      GLenum pname, GLint param) \
 	GL_FUNC(void,   glActiveTexture,    GLenum texture) \
+	GL_FUNC(const GLubyte *, glGetString, GLenum name) \
+	GL_FUNC(void,   glGetIntegerv,      GLenum pname, GLint *data) \
+	/* end function list */
+
+// From GL_ARB_get_program_binary. These are loaded if present and left NULL
+// otherwise, so check before calling them.
+#define GL_PROGRAM_BINARY_FUNCTIONS \
+	GL_FUNC(void,   glGetProgramBinary, GLuint program, GLsizei bufSize, GLsizei *length, \
+		GLenum *binaryFormat, void *binary) \
+	GL_FUNC(void,   glProgramBinary,    GLuint program, GLenum binaryFormat, const void *binary, \
+		GLsizei length) \
+	GL_FUNC(void,   glProgramParameteri, GLuint program, GLenum pname, GLint value) \
 	/* end function list */
 
 #define GL_FUNC(return_type, name, ...) \
 	typedef return_type _##name(__VA_ARGS__); \
 	extern _##name *name;
 GL_3_3_FUNCTIONS
+GL_PROGRAM_BINARY_FUNCTIONS
 #undef GL_FUNC
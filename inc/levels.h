@@ -1,5 +1,61 @@
 #pragma once
 
+#include <stdio.h>
+
 #include "game.h"
 
-i32 build_level(struct level *level, u32 n);
+// Levels are compiled from ASCII files by pack_levels into a pack that's
+// mapped at startup. A pack is a little-endian header, an index and then
+// the levels:
+//    0  "LDLV"
+//    4  u16 version
+//    6  u16 number of levels
+//    8  u32 FNV-1a of the index
+//   12  4 bytes of padding
+// and for each level, from offset 16, an index entry:
+//    0  u32 offset of the level from the start of the pack
+//    4  u32 size
+//    8  u32 FNV-1a of the level
+// Each level is:
+//    0  u8 width, height, layers and number of colours
+//    4  u16 number of blocks, not counting the empty block
+//    6  2 bytes of padding
+//    8  f32 camera position x, y, z, then look-at x, y, z
+//   32  f32 r, g, b of the background, player and goal colours
+//   68  per colour, f32 r, g, b and a u8 of player health
+// then per block, in block id order, u8 type, i8 x, y, z and u8 colour.
+#define LEVEL_PACK_HEADER_SIZE 16
+#define LEVEL_PACK_ENTRY_SIZE  12
+#define LEVEL_HEADER_SIZE      68
+#define LEVEL_COLOR_SIZE       13
+#define LEVEL_BLOCK_SIZE       5
+#define LEVEL_PACK_VERSION     1
+
+// Where the tools look for the pack when not told.
+#define DEFAULT_LEVEL_PACK "bin/levels.pak"
+
+enum level_pack_error {
+	LEVEL_PACK_OK,
+	LEVEL_PACK_NOT_FOUND,
+	LEVEL_PACK_TRUNCATED,
+	LEVEL_PACK_BAD_MAGIC,
+	LEVEL_PACK_BAD_VERSION,
+	LEVEL_PACK_BAD_CHECKSUM,
+	LEVEL_PACK_BAD_LEVEL,
+	LEVEL_PACK_NO_LEVEL,
+};
+
+// Maps the pack and checks its index. Returns LEVEL_PACK_NOT_FOUND, with
+// errno set, if it can't be opened.
+enum level_pack_error open_levels(const char *path);
+void close_levels(void);
+u32 num_pack_levels(void);
+
+// Seeks straight to level n through the index and fills in level from it.
+// Returns LEVEL_PACK_NO_LEVEL past the last level, and LEVEL_PACK_BAD_LEVEL
+// for one without exactly one player. Safe to call from several threads at
+// once.
+enum level_pack_error build_level(struct level *level, u32 n);
+
+i32 write_level_pack(FILE *out, struct level *levels, u32 num_levels);
+const char *level_pack_error_string(enum level_pack_error error);
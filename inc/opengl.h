@@ -1,41 +1,114 @@
 #pragma once
 
+// Starts reading textures on a worker thread, so the disk overlaps creating
+// the window and GL context. init_opengl waits for it and does the uploads.
+void start_loading_textures(void);
+// Waits for the worker and drops what it read, for when init_opengl won't
+// be called.
+void cancel_loading_textures(void);
+
 i32 init_opengl(void);
 void quit_opengl(void);
 void test_draw(void);
 
-struct camera_params {
+void set_camera(struct camera_params params);
+
+// Keep in step with the constants in the vertex shaders' motion code.
+enum motion_type {
+	MOTION_IDLE,
+	MOTION_MOVE,
+	MOTION_FALL,
+	MOTION_REBOUND,
+	// Rises out of sight and is hidden once it's done.
+	MOTION_COLLECT,
+};
+
+// Offset by mag * sin(off + freq * time) on each axis while not in motion.
+struct idle_params {
 	struct {
 		f32 x, y, z;
-	} camera_pos;
+	} mag, off, freq;
+};
+
+// Played by the vertex shaders between start_time and start_time + duration.
+// from is where a move or fall started, or the direction of a rebound.
+struct motion_params {
+	u32 type; // enum motion_type
+	f32 start_time, duration;
 	struct {
 		f32 x, y, z;
-	} look_at;
+	} from;
 };
 
-void set_camera(struct camera_params params);
-
 struct cube_params {
 	f32 r, g, b;
 	f32 x, y, z;
+	struct idle_params idle;
+	struct motion_params motion;
 };
 
+// Instances stay put between frames and are only uploaded again when they
+// change. add_cube returns the instance to pass to set_cube_motion.
 void reset_cubes(void);
-void add_cube(struct cube_params params);
+u32 add_cube(struct cube_params params);
+void set_cube_motion(u32 cube, f32 x, f32 y, f32 z,
+	struct motion_params motion);
+struct static_cube_params {
+	f32 r, g, b;
+	// Grid cell, with y up.
+	i8 x, y, z;
+};
+
+// Cubes that never move are baked into one mesh, with the faces shared by two
+// of them left out and the gap between them closed. The next level's mesh is
+// baked off the main thread from its cubes and camera, and
+// use_next_static_cubes swaps it in on the main thread and uploads it.
+void bake_next_static_cubes(const struct static_cube_params *cubes,
+	u32 num_cubes, struct camera_params camera);
+void use_next_static_cubes(void);
+// Time in seconds the cube and item animations and text flashes are
+// evaluated at.
+void set_world_time(f32 time);
 void draw_world(void);
 
+// Text stays put between frames, and its glyphs are only uploaded again when
+// it changes. add_text returns the text to pass to set_text and flash_text.
+// Only the first MAX_TEXT_LENGTH characters of a string are shown; the rest
+// are dropped. reset_characters removes every text.
 void reset_characters(void);
-void add_string(char *string, struct color color, f32 zoom, f32 x, f32 y);
+u32 add_text(char *string, struct color color, f32 zoom, f32 x, f32 y);
+void set_text(u32 text, char *string, struct color color);
+// Shows the text in white for every other of num_flashes equal parts of the
+// duration, starting with the first.
+void flash_text(u32 text, f32 start_time, f32 duration, u32 num_flashes);
 void draw_characters(void);
 
 struct item_params {
 	f32 r, g, b;
 	f32 x, y, z;
 	u8 character;
+	struct idle_params idle;
+	struct motion_params motion;
 };
 
 void reset_items(void);
-void add_item(struct item_params params);
+u32 add_item(struct item_params params);
+void set_item_motion(u32 item, f32 x, f32 y, f32 z,
+	struct motion_params motion);
 
 void set_fade_color(f32 r, f32 g, f32 b, f32 a);
 void draw_fade(void);
+
+// Counts for all the world and text draws together.
+struct render_stats {
+	u32 draw_calls;
+	u64 triangles;
+	// Written to the cube, item and font instance streams.
+	u64 bytes_uploaded;
+	u32 uploads;
+	// Uploads that had to wait for the GPU to finish with a region.
+	u32 sync_waits;
+};
+
+// Returns the counts since the last call and starts them again.
+struct render_stats take_render_stats(void);
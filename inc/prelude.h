@@ -18,6 +18,15 @@ struct color {
 	f32 r, g, b;
 };
 
+struct camera_params {
+	struct {
+		f32 x, y, z;
+	} camera_pos;
+	struct {
+		f32 x, y, z;
+	} look_at;
+};
+
 #define ARRAY_LENGTH(xs) (sizeof(xs) / sizeof((xs)[0]))
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
@@ -34,11 +43,12 @@ struct color {
 
 #define MAX_CUBES        1000
 #define MAX_LETTERS      1000
+#define MAX_TEXT_LENGTH  32
 #define MAX_ITEMS        1000
 #define MAX_BLOCKS       (MAX_CUBES + MAX_ITEMS)
 #define MAX_COLORS       10
 #define MAX_EVENTS       1000
-#define MAX_HEALTH_TEXT  100
+#define MAX_HEALTH_TEXT  (MAX_TEXT_LENGTH + 1)
 #define MAX_LEVEL_WIDTH  21
 #define MAX_LEVEL_HEIGHT 21
 #define MAX_LEVEL_LAYERS 10
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "gl_3_3.h"
+
+// Linked programs are kept between runs in the user's pref directory, keyed
+// by a hash of their sources, so startup can skip compiling GLSL. The whole
+// cache is dropped when the driver's vendor, renderer or version changes.
+// Without GL_ARB_get_program_binary every call here does nothing.
+void open_program_cache(void);
+// Writes out the programs loaded or saved since it was opened, dropping
+// entries for sources this run never asked for.
+void close_program_cache(void);
+
+// Returns a linked program for the sources, or 0 if there's none cached or
+// the driver rejects the binary.
+GLuint load_cached_program(const GLchar *vert_src, const GLchar *frag_src);
+// Call before linking a program that will be saved.
+void hint_program_retrievable(GLuint program);
+void save_cached_program(GLuint program, const GLchar *vert_src,
+	const GLchar *frag_src);
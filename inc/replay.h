@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "game.h"
+
+// A replay file is any number of records back to back. Each record is a
+// little-endian header followed by the moves, four to a byte with the
+// first move in the low bits (0 up, 1 down, 2 left, 3 right):
+//    0  "LD44"
+//    4  u16 version
+//    6  u16 level
+//    8  u32 seed passed to srand() before the level started
+//   12  u32 number of moves
+//   16  u64 hash_events() of every event play_move produced
+//   24  u8  every enum move_result bit seen
+//   25  3 bytes of padding
+//   28  u32 FNV-1a of the rest of the header and the moves
+#define REPLAY_HEADER_SIZE 32
+#define REPLAY_VERSION     1
+
+struct replay {
+	u32 level;
+	u32 seed;
+	u32 num_moves, cap_moves;
+	u8 *moves;
+	u64 event_hash;
+	u32 result;
+};
+
+enum replay_error {
+	REPLAY_OK,
+	REPLAY_END,
+	REPLAY_TRUNCATED,
+	REPLAY_BAD_MAGIC,
+	REPLAY_BAD_VERSION,
+	REPLAY_BAD_CHECKSUM,
+	REPLAY_OUT_OF_MEMORY,
+};
+
+void init_replay(struct replay *replay, u32 level, u32 seed);
+void free_replay(struct replay *replay);
+// Appends a move and folds the events play_move returned for it into the
+// hash and result. Returns non-zero when out of memory.
+i32 record_move(struct replay *replay, enum move move,
+	struct event *events, u32 num_events);
+enum move get_replay_move(struct replay *replay, u32 i);
+u64 hash_events(u64 hash, struct event *events, u32 num_events);
+// The enum move_result bits play_move_fast would have returned for a move
+// that produced these events.
+u32 events_result(struct event *events, u32 num_events);
+
+i32 write_replay(FILE *file, struct replay *replay);
+// Reads the record at *offset in data and moves *offset past it. Returns
+// REPLAY_END once there are no records left.
+enum replay_error read_replay(const u8 *data, u64 size, u64 *offset,
+	struct replay *replay);
+const char *replay_error_string(enum replay_error error);
+
+// Plays the moves with play_move on a copy of start, which must be the
+// replay's level as built by build_level, and checks the event hash and
+// result against the recording. Returns non-zero when they differ.
+i32 verify_replay(struct replay *replay, struct level *start,
+	struct level *scratch);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "game.h"
+
+#define MAX_SOLUTION_MOVES 1000
+#define MAX_SOLVER_THREADS 64
+
+enum solve_result {
+	SOLVE_FOUND,
+	SOLVE_NO_SOLUTION,
+	SOLVE_OUT_OF_MEMORY,
+	SOLVE_STATE_LIMIT,
+};
+
+struct solution {
+	u32 num_moves;
+	enum move moves[MAX_SOLUTION_MOVES];
+};
+
+struct solve_thread_stats {
+	u64 nodes_expanded;
+	u64 moves_played;
+	u64 steals;
+};
+
+struct solve_stats {
+	u64 nodes_expanded;
+	u64 moves_played;
+	u64 steals;
+	u64 states_seen;
+	u64 peak_bytes;
+	u32 num_threads;
+	struct solve_thread_stats threads[MAX_SOLVER_THREADS];
+};
+
+// A* search over play_move_fast. Finds a shortest sequence of moves that
+// wins the level without dying, or proves that none exists. Gives up once
+// max_states distinct states have been stored, unless max_states is 0.
+// Each f = g + h is searched by num_threads threads at once, which share
+// the work by stealing nodes from each other.
+enum solve_result solve_level(
+	struct level *level,
+	u32 num_threads,
+	u32 max_states,
+	struct solution *solution_out,
+	struct solve_stats *stats_out);
@@ -0,0 +1,15 @@
+#pragma once
+
+// A texture file is a little-endian u16 width and height followed by the
+// texels a row at a time, either one coverage byte each or, in files from
+// before pack_font, four RGBA bytes each.
+struct __attribute__((__packed__)) texture {
+	u16 width, height;
+	u8 texels[0];
+};
+
+// Coverage from an old RGBA texel. The shaders discard zero coverage, as they
+// used to discard zero alpha, so opaque black is kept just above it.
+inline static u8 rgba_coverage(const u8 *texel) {
+	return texel[3] ? MAX(MAX(texel[0], texel[1]), MAX(texel[2], 1)) : 0;
+}
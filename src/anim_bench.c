@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "animators.h"
+
+#define DEFAULT_FRAMES 2000
+#define FRAME_TIME     (1.0f / 60.0f)
+// Share of entries that start a motion each frame.
+#define START_RATE     0.02f
+
+static f64 wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+static f32 rand_f32(f32 min, f32 max) {
+	return (((f32)rand()) / ((f32)RAND_MAX)) * (max - min) + min;
+}
+
+static i32 bench(u32 num_entries, u32 num_frames) {
+	struct animators anims;
+	if (init_animators(&anims, num_entries)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (u32 i = 0; i < num_entries; ++i) {
+		struct idle_params idle;
+		idle.mag.x  = rand_f32(0.025f, 0.05f);
+		idle.off.x  = rand_f32(0.0f, 6.3f);
+		idle.freq.x = rand_f32(0.75f, 1.5f);
+		idle.mag.y  = rand_f32(0.025f, 0.05f);
+		idle.off.y  = rand_f32(0.0f, 6.3f);
+		idle.freq.y = rand_f32(0.75f, 1.5f);
+		idle.mag.z  = rand_f32(0.025f, 0.05f);
+		idle.off.z  = rand_f32(0.0f, 6.3f);
+		idle.freq.z = rand_f32(0.75f, 1.5f);
+		add_animator(&anims, i, i, 0, (f32)(i % 21), (f32)(i / 441),
+			(f32)(i / 21 % 21), idle);
+	}
+
+	u32 starts_per_frame = (u32)(num_entries * START_RATE) + 1;
+	u64 num_active = 0;
+	f64 start_time = 0.0, update_time = 0.0;
+	f32 time = 0.0f;
+	for (u32 frame = 0; frame < num_frames; ++frame) {
+		time += FRAME_TIME;
+		f64 t0 = wall_time();
+		for (u32 i = 0; i < starts_per_frame; ++i) {
+			struct anim_entry entry;
+			u32 block_id = rand() % num_entries;
+			switch (rand() % 3) {
+			case 0:
+				start_animator(&anims, block_id, ANIM_MOVING,
+					time, MOVE_DURATION, 1.0f, 0.0f, 1.0f, &entry);
+				break;
+			case 1:
+				start_animator(&anims, block_id, ANIM_FALLING,
+					time, 0.3f, 1.0f, -1.0f, 1.0f, &entry);
+				break;
+			case 2:
+				start_animator(&anims, block_id, ANIM_REBOUND,
+					time, BOUNCE_DURATION, 1.0f, 0.0f, 0.0f, &entry);
+				break;
+			}
+		}
+		f64 t1 = wall_time();
+		u32 num_landed = 0;
+		num_active += update_animators(&anims, time, &num_landed);
+		f64 t2 = wall_time();
+		start_time  += t1 - t0;
+		update_time += t2 - t1;
+	}
+	free_animators(&anims);
+
+	f64 entry_frames = (f64)num_entries * num_frames;
+	printf("%6u entries, %5llu in motion: update %6.2f ns/entry "
+		"(%6.1f M/s), start %6.1f ns\n",
+		num_entries,
+		(unsigned long long)(num_active / num_frames),
+		update_time * 1e9 / entry_frames,
+		entry_frames / update_time / 1e6,
+		start_time * 1e9 / ((f64)starts_per_frame * num_frames));
+	return 0;
+}
+
+// Times update_animators and start_animator over a run of frames with a
+// steady trickle of motions starting, at a few store sizes. Positions are
+// worked out in the vertex shaders, so there's nothing else to time.
+i32 main(i32 argc, char *argv[]) {
+	u32 num_frames = DEFAULT_FRAMES;
+	i32 opt;
+	while ((opt = getopt(argc, argv, "f:")) != -1) {
+		switch (opt) {
+		case 'f':
+			num_frames = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-f frames]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (num_frames == 0) {
+		fprintf(stderr, "need at least one frame\n");
+		return EXIT_FAILURE;
+	}
+
+	u32 sizes[] = { 1000, 10000, 100000 };
+	srand(1);
+	for (u32 i = 0; i < ARRAY_LENGTH(sizes); ++i) {
+		if (bench(sizes[i], num_frames)) {
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
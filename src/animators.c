@@ -0,0 +1,226 @@
+#include "animators.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOT(group, index) (((u32)(group) << 24) | (index))
+#define SLOT_GROUP(slot)   ((slot) >> 24)
+#define SLOT_INDEX(slot)   ((slot) & 0xffffff)
+
+i32 init_animators(struct animators *anims, u32 capacity) {
+	memset(anims, 0, sizeof(*anims));
+	assert(capacity <= SLOT_INDEX(NO_ANIMATOR));
+	anims->capacity = capacity;
+	// Whole blocks of lanes are always allocated, and lanes with no entry
+	// have an end time that never passes.
+	u32 padded = (capacity + ANIM_LANES - 1) / ANIM_LANES * ANIM_LANES;
+	for (u32 g = 0; g < ANIM_NUM_GROUPS; ++g) {
+		struct anim_group_entries *e = &anims->groups[g];
+		e->block_id = malloc(padded * sizeof(u32));
+		e->instance = malloc(padded * sizeof(u32));
+		e->is_char  = malloc(padded * sizeof(u8));
+		if (!e->block_id || !e->instance || !e->is_char) {
+			goto error;
+		}
+		for (u32 c = 0; c < ANIM_NUM_COLUMNS; ++c) {
+			e->columns[c] = calloc(padded, sizeof(f32));
+			if (e->columns[c] == NULL) {
+				goto error;
+			}
+		}
+		for (u32 i = 0; i < padded; ++i) {
+			e->columns[ANIM_END_TIME][i] = INFINITY;
+		}
+	}
+	anims->slots = malloc(capacity * sizeof(u32));
+	if (anims->slots == NULL) {
+		goto error;
+	}
+	reset_animators(anims);
+	return 0;
+error:
+	free_animators(anims);
+	return 1;
+}
+
+void free_animators(struct animators *anims) {
+	for (u32 g = 0; g < ANIM_NUM_GROUPS; ++g) {
+		struct anim_group_entries *e = &anims->groups[g];
+		free(e->block_id);
+		free(e->instance);
+		free(e->is_char);
+		for (u32 c = 0; c < ANIM_NUM_COLUMNS; ++c) {
+			free(e->columns[c]);
+		}
+	}
+	free(anims->slots);
+	memset(anims, 0, sizeof(*anims));
+}
+
+void reset_animators(struct animators *anims) {
+	for (u32 g = 0; g < ANIM_NUM_GROUPS; ++g) {
+		struct anim_group_entries *e = &anims->groups[g];
+		for (u32 i = 0; i < e->count; ++i) {
+			e->columns[ANIM_END_TIME][i] = INFINITY;
+		}
+		e->count = 0;
+	}
+	for (u32 i = 0; i < anims->capacity; ++i) {
+		anims->slots[i] = NO_ANIMATOR;
+	}
+}
+
+static void copy_entry(struct anim_group_entries *dst, u32 j,
+		struct anim_group_entries *src, u32 i) {
+	dst->block_id[j] = src->block_id[i];
+	dst->instance[j] = src->instance[i];
+	dst->is_char[j]  = src->is_char[i];
+	for (u32 c = 0; c < ANIM_NUM_COLUMNS; ++c) {
+		dst->columns[c][j] = src->columns[c][i];
+	}
+}
+
+static void remove_entry(struct animators *anims, u32 group, u32 i) {
+	struct anim_group_entries *e = &anims->groups[group];
+	anims->slots[e->block_id[i]] = NO_ANIMATOR;
+	u32 last = --e->count;
+	if (i != last) {
+		copy_entry(e, i, e, last);
+		anims->slots[e->block_id[i]] = SLOT(group, i);
+	}
+	e->columns[ANIM_END_TIME][last] = INFINITY;
+}
+
+static u32 move_entry(struct animators *anims, u32 from, u32 i, u32 to) {
+	if (from == to) {
+		return i;
+	}
+	struct anim_group_entries *dst = &anims->groups[to];
+	assert(dst->count < anims->capacity);
+	u32 j = dst->count++;
+	copy_entry(dst, j, &anims->groups[from], i);
+	remove_entry(anims, from, i);
+	anims->slots[dst->block_id[j]] = SLOT(to, j);
+	return j;
+}
+
+void add_animator(struct animators *anims, u32 block_id, u32 instance,
+		u8 is_char, f32 x, f32 y, f32 z, struct idle_params idle) {
+	assert(block_id < anims->capacity);
+	assert(anims->slots[block_id] == NO_ANIMATOR);
+	struct anim_group_entries *e = &anims->groups[ANIM_IDLE];
+	u32 i = e->count++;
+	e->block_id[i] = block_id;
+	e->instance[i] = instance;
+	e->is_char[i]  = is_char;
+	f32 **c = e->columns;
+	c[ANIM_X][i] = x;
+	c[ANIM_Y][i] = y;
+	c[ANIM_Z][i] = z;
+	c[ANIM_FROM_X][i] = c[ANIM_FROM_Y][i] = c[ANIM_FROM_Z][i] = 0.0f;
+	c[ANIM_START_TIME][i] = c[ANIM_DURATION][i] = 0.0f;
+	c[ANIM_END_TIME][i] = INFINITY;
+	c[ANIM_MAG_X][i]  = idle.mag.x;
+	c[ANIM_MAG_Y][i]  = idle.mag.y;
+	c[ANIM_MAG_Z][i]  = idle.mag.z;
+	c[ANIM_OFF_X][i]  = idle.off.x;
+	c[ANIM_OFF_Y][i]  = idle.off.y;
+	c[ANIM_OFF_Z][i]  = idle.off.z;
+	c[ANIM_FREQ_X][i] = idle.freq.x;
+	c[ANIM_FREQ_Y][i] = idle.freq.y;
+	c[ANIM_FREQ_Z][i] = idle.freq.z;
+	anims->slots[block_id] = SLOT(ANIM_IDLE, i);
+}
+
+struct motion_params start_animator(struct animators *anims, u32 block_id,
+		enum anim_group group, f32 start_time, f32 duration,
+		f32 x, f32 y, f32 z, struct anim_entry *entry_out) {
+	u32 slot = anims->slots[block_id];
+	assert(slot != NO_ANIMATOR);
+	u32 i = move_entry(anims, SLOT_GROUP(slot), SLOT_INDEX(slot), group);
+	struct anim_group_entries *e = &anims->groups[group];
+	f32 **c = e->columns;
+	struct motion_params motion = {
+		.start_time = start_time,
+		.duration   = duration,
+	};
+	switch (group) {
+	case ANIM_IDLE:
+		motion.type = MOTION_IDLE;
+		break;
+	case ANIM_MOVING:
+	case ANIM_FALLING:
+		motion.type = group == ANIM_MOVING ? MOTION_MOVE : MOTION_FALL;
+		motion.from.x = c[ANIM_X][i];
+		motion.from.y = c[ANIM_Y][i];
+		motion.from.z = c[ANIM_Z][i];
+		c[ANIM_X][i] = x;
+		c[ANIM_Y][i] = y;
+		c[ANIM_Z][i] = z;
+		break;
+	case ANIM_REBOUND:
+		motion.type = MOTION_REBOUND;
+		motion.from.x = x;
+		motion.from.y = y;
+		motion.from.z = z;
+		break;
+	case ANIM_COLLECTING:
+		motion.type = MOTION_COLLECT;
+		break;
+	case ANIM_NUM_GROUPS:
+		assert(0);
+	}
+	c[ANIM_FROM_X][i]     = motion.from.x;
+	c[ANIM_FROM_Y][i]     = motion.from.y;
+	c[ANIM_FROM_Z][i]     = motion.from.z;
+	c[ANIM_START_TIME][i] = start_time;
+	c[ANIM_DURATION][i]   = duration;
+	c[ANIM_END_TIME][i]   = group == ANIM_IDLE
+		? INFINITY : start_time + duration;
+
+	entry_out->instance = e->instance[i];
+	entry_out->is_char  = e->is_char[i];
+	entry_out->x = c[ANIM_X][i];
+	entry_out->y = c[ANIM_Y][i];
+	entry_out->z = c[ANIM_Z][i];
+	return motion;
+}
+
+u32 update_animators(struct animators *anims, f32 time, u32 *num_landed) {
+	u32 num_active = 0;
+	for (u32 g = ANIM_IDLE + 1; g < ANIM_NUM_GROUPS; ++g) {
+		struct anim_group_entries *e = &anims->groups[g];
+		const f32 *end_time = e->columns[ANIM_END_TIME];
+		// Blocks of lanes are tested at once and only blocks with a
+		// finished entry are walked one by one. Going from the back means
+		// entries swapped down from the end have already been tested.
+		u32 num_blocks = (e->count + ANIM_LANES - 1) / ANIM_LANES;
+		for (u32 b = num_blocks; b-- > 0;) {
+			const f32 *lane_end = &end_time[b * ANIM_LANES];
+			u32 finished = 0;
+			for (u32 l = 0; l < ANIM_LANES; ++l) {
+				finished |= (u32)(time > lane_end[l]) << l;
+			}
+			for (u32 l = ANIM_LANES; finished && l-- > 0;) {
+				u32 i = b * ANIM_LANES + l;
+				if (!(finished & (1u << l)) || i >= e->count) {
+					continue;
+				}
+				if (g == ANIM_COLLECTING) {
+					remove_entry(anims, g, i);
+				} else {
+					if (g == ANIM_FALLING) {
+						++*num_landed;
+					}
+					u32 j = move_entry(anims, g, i, ANIM_IDLE);
+					anims->groups[ANIM_IDLE]
+						.columns[ANIM_END_TIME][j] = INFINITY;
+				}
+			}
+		}
+		num_active += e->count;
+	}
+	return num_active;
+}
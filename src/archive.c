@@ -0,0 +1,164 @@
+#include "archive.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytes.h"
+
+static const u8 archive_magic[4] = { 'L', 'D', 'P', 'K' };
+
+static u64 align_up(u64 x) {
+	return (x + ARCHIVE_ALIGN - 1) & ~(u64)(ARCHIVE_ALIGN - 1);
+}
+
+enum archive_error open_archive(const char *path, struct archive *archive) {
+	if (map_file(path, &archive->file)) {
+		return ARCHIVE_NOT_FOUND;
+	}
+	enum archive_error error = ARCHIVE_TRUNCATED;
+	const u8 *data = archive->file.data;
+	u64 size = archive->file.size;
+	if (size < ARCHIVE_HEADER_SIZE) {
+		goto error;
+	}
+	error = ARCHIVE_BAD_MAGIC;
+	if (memcmp(data, archive_magic, sizeof(archive_magic)) != 0) {
+		goto error;
+	}
+	error = ARCHIVE_BAD_VERSION;
+	if (get_u16(data + 4) != ARCHIVE_VERSION) {
+		goto error;
+	}
+	u32 num_entries = get_u16(data + 6);
+	u64 toc_size = (u64)num_entries * ARCHIVE_ENTRY_SIZE;
+	error = ARCHIVE_TRUNCATED;
+	if (size - ARCHIVE_HEADER_SIZE < toc_size) {
+		goto error;
+	}
+	const u8 *toc = data + ARCHIVE_HEADER_SIZE;
+	error = ARCHIVE_BAD_CHECKSUM;
+	if (get_u32(data + 8) != fnv32(FNV_OFFSET_32, toc, toc_size)) {
+		goto error;
+	}
+	// Every entry has to lie inside the file, so find_asset needn't check.
+	for (u32 i = 0; i < num_entries; ++i) {
+		const u8 *entry = toc + i * ARCHIVE_ENTRY_SIZE;
+		u64 offset = get_u64(entry + 32);
+		error = ARCHIVE_TRUNCATED;
+		if (offset > size || size - offset < get_u32(entry + 40)) {
+			goto error;
+		}
+		error = ARCHIVE_BAD_NAME;
+		if (entry[ARCHIVE_NAME_SIZE - 1] != '\0') {
+			goto error;
+		}
+	}
+	archive->num_entries = num_entries;
+	archive->toc = toc;
+	return ARCHIVE_OK;
+
+error:
+	unmap_file(&archive->file);
+	return error;
+}
+
+void close_archive(struct archive *archive) {
+	unmap_file(&archive->file);
+	archive->num_entries = 0;
+	archive->toc = NULL;
+}
+
+enum archive_error find_asset(const struct archive *archive,
+		const char *name, const u8 **data, u64 *size) {
+	for (u32 i = 0; i < archive->num_entries; ++i) {
+		const u8 *entry = archive->toc + i * ARCHIVE_ENTRY_SIZE;
+		if (strcmp((const char *)entry, name) != 0) {
+			continue;
+		}
+		const u8 *asset = archive->file.data + get_u64(entry + 32);
+		u32 asset_size = get_u32(entry + 40);
+		if (get_u32(entry + 44) != fnv32(FNV_OFFSET_32, asset, asset_size)) {
+			return ARCHIVE_BAD_CHECKSUM;
+		}
+		*data = asset;
+		*size = asset_size;
+		return ARCHIVE_OK;
+	}
+	return ARCHIVE_NOT_FOUND;
+}
+
+static const char *base_name(const char *path) {
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+static i32 write_padding(FILE *out, u64 size) {
+	static const u8 zeros[ARCHIVE_ALIGN];
+	return size && fwrite(zeros, size, 1, out) != 1;
+}
+
+i32 write_archive(FILE *out, u32 num_assets, const char *const *paths,
+		const struct mapped_file *assets) {
+	if (num_assets > 0xffff) {
+		return 1;
+	}
+	u8 header[ARCHIVE_HEADER_SIZE] = { 0 };
+	u64 toc_size = (u64)num_assets * ARCHIVE_ENTRY_SIZE;
+	u8 *toc = calloc(num_assets ? toc_size : 1, 1);
+	if (toc == NULL) {
+		return 1;
+	}
+	i32 result = 1;
+	u64 offset = align_up(ARCHIVE_HEADER_SIZE + toc_size);
+	for (u32 i = 0; i < num_assets; ++i) {
+		u8 *entry = toc + i * ARCHIVE_ENTRY_SIZE;
+		const char *name = base_name(paths[i]);
+		if (strlen(name) >= ARCHIVE_NAME_SIZE
+				|| assets[i].size > 0xffffffffu) {
+			goto error;
+		}
+		memcpy(entry, name, strlen(name));
+		put_u64(entry + 32, offset);
+		put_u32(entry + 40, assets[i].size);
+		put_u32(entry + 44,
+			fnv32(FNV_OFFSET_32, assets[i].data, assets[i].size));
+		offset = align_up(offset + assets[i].size);
+	}
+	memcpy(header, archive_magic, sizeof(archive_magic));
+	put_u16(header + 4, ARCHIVE_VERSION);
+	put_u16(header + 6, num_assets);
+	put_u32(header + 8, fnv32(FNV_OFFSET_32, toc, toc_size));
+	if (fwrite(header, sizeof(header), 1, out) != 1
+			|| (toc_size && fwrite(toc, toc_size, 1, out) != 1)) {
+		goto error;
+	}
+	u64 written = ARCHIVE_HEADER_SIZE + toc_size;
+	for (u32 i = 0; i < num_assets; ++i) {
+		if (write_padding(out, align_up(written) - written)) {
+			goto error;
+		}
+		written = align_up(written);
+		if (assets[i].size && fwrite(assets[i].data, assets[i].size, 1,
+				out) != 1) {
+			goto error;
+		}
+		written += assets[i].size;
+	}
+	result = 0;
+error:
+	free(toc);
+	return result;
+}
+
+const char *archive_error_string(enum archive_error error) {
+	switch (error) {
+	case ARCHIVE_OK:           return "ok";
+	case ARCHIVE_TRUNCATED:    return "truncated archive";
+	case ARCHIVE_BAD_MAGIC:    return "not an asset archive";
+	case ARCHIVE_BAD_VERSION:  return "unsupported version";
+	case ARCHIVE_BAD_CHECKSUM: return "checksum mismatch";
+	case ARCHIVE_BAD_NAME:     return "bad asset name";
+	case ARCHIVE_NOT_FOUND:    return "not found";
+	}
+	return "unknown error";
+}
@@ -0,0 +1,91 @@
+#include "assets.h"
+
+#include <errno.h>
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+
+static struct archive archive;
+static i32 have_archive;
+
+char *asset_path(const char *name) {
+	char *base_path = SDL_GetBasePath();
+	if (base_path == NULL) {
+		SDL_Log("Unable to find the asset directory: %s",
+			SDL_GetError());
+		return NULL;
+	}
+	char *path = malloc(strlen(base_path) + strlen(name) + 1);
+	if (path == NULL) {
+		SDL_Log("Out of memory loading '%s'", name);
+	} else {
+		strcpy(path, base_path);
+		strcat(path, name);
+	}
+	SDL_free(base_path);
+	return path;
+}
+
+i32 open_assets(void) {
+	char *path = asset_path("assets.pak");
+	if (path == NULL) {
+		return 1;
+	}
+	i32 result = 0;
+	enum archive_error error = open_archive(path, &archive);
+	if (error == ARCHIVE_OK) {
+		have_archive = 1;
+	} else if (error == ARCHIVE_NOT_FOUND && errno == ENOENT) {
+		SDL_Log("No '%s', loading loose asset files", path);
+	} else {
+		SDL_Log("Unable to open '%s': %s", path,
+			error == ARCHIVE_NOT_FOUND ? strerror(errno)
+				: archive_error_string(error));
+		result = 1;
+	}
+	free(path);
+	return result;
+}
+
+void close_assets(void) {
+	if (have_archive) {
+		close_archive(&archive);
+		have_archive = 0;
+	}
+}
+
+i32 load_asset(const char *name, struct asset *asset) {
+	asset->file.data = NULL;
+	asset->file.size = 0;
+	if (have_archive) {
+		enum archive_error error = find_asset(&archive, name,
+			&asset->data, &asset->size);
+		if (error != ARCHIVE_OK) {
+			SDL_Log("Unable to load '%s' from the asset archive: %s",
+				name, archive_error_string(error));
+			return 1;
+		}
+		return 0;
+	}
+	char *path = asset_path(name);
+	if (path == NULL) {
+		return 1;
+	}
+	i32 result = map_file(path, &asset->file);
+	if (result) {
+		SDL_Log("Unable to read '%s': %s", path, strerror(errno));
+	} else {
+		asset->data = asset->file.data;
+		asset->size = asset->file.size;
+	}
+	free(path);
+	return result;
+}
+
+void free_asset(struct asset *asset) {
+	unmap_file(&asset->file);
+	asset->data = NULL;
+	asset->size = 0;
+}
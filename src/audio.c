@@ -5,91 +5,101 @@
 #include <SDL.h>
 #include <SDL_mixer.h>
 
-static Mix_Chunk *mix_chunk_move    = NULL;
-static Mix_Chunk *mix_chunk_heart   = NULL;
-static Mix_Chunk *mix_chunk_fall    = NULL;
-static Mix_Chunk *mix_chunk_hurt    = NULL;
-static Mix_Chunk *mix_chunk_victory = NULL;
+#include "assets.h"
 
+static char *sound_files[] = {
+	[SOUND_MOVE]    = "move.wav",
+	[SOUND_HEART]   = "heart.wav",
+	[SOUND_FALL]    = "fall.wav",
+	[SOUND_HURT]    = "hurt.wav",
+	[SOUND_VICTORY] = "victory.wav",
+};
+
+static Mix_Chunk *mix_chunks[ARRAY_LENGTH(sound_files)];
+
+static SDL_Thread *sound_thread;
+
+// The WAV is decoded straight out of the asset, without reading it into a
+// buffer first.
 static Mix_Chunk *load_sound(char *filename) {
-	char *base_dir = SDL_GetBasePath();
-	u32 len = strlen(filename) + strlen(base_dir) + 1;
-	char *full_filename = malloc(len * sizeof(char));
-	full_filename[0] = '\0';
-	strcat(full_filename, base_dir);
-	strcat(full_filename, filename);
-	SDL_free(base_dir);
-	Mix_Chunk *result = Mix_LoadWAV(full_filename);
-	free(full_filename);
+	struct asset asset;
+	if (load_asset(filename, &asset)) {
+		return NULL;
+	}
+	Mix_Chunk *result = NULL;
+	SDL_RWops *rw = SDL_RWFromConstMem(asset.data, asset.size);
+	if (rw) {
+		result = Mix_LoadWAV_RW(rw, 1);
+	}
+	if (result == NULL) {
+		SDL_Log("Error loading '%s': %s", filename, Mix_GetError());
+	}
+	free_asset(&asset);
 	return result;
 }
 
-i32 init_audio(void) {
-	mix_chunk_move = load_sound("move.wav");
-	if (mix_chunk_move == NULL) {
-		SDL_Log("Error loading 'move.wav': %s", Mix_GetError());
-		goto error_load_move;
+static void free_sounds(void) {
+	for (u32 i = 0; i < ARRAY_LENGTH(mix_chunks); ++i) {
+		Mix_FreeChunk(mix_chunks[i]);
+		mix_chunks[i] = NULL;
 	}
-	mix_chunk_heart = load_sound("heart.wav");
-	if (mix_chunk_heart == NULL) {
-		SDL_Log("Error loading 'heart.wav': %s", Mix_GetError());
-		goto error_load_heart;
+}
+
+// Decodes every sound. Only needs the mixer open, not the main thread.
+static i32 load_sounds(void *data) {
+	u64 start = SDL_GetPerformanceCounter();
+	for (u32 i = 0; i < ARRAY_LENGTH(sound_files); ++i) {
+		mix_chunks[i] = load_sound(sound_files[i]);
+		if (mix_chunks[i] == NULL) {
+			free_sounds();
+			return 1;
+		}
 	}
-	mix_chunk_fall = load_sound("fall.wav");
-	if (mix_chunk_fall == NULL) {
-		SDL_Log("Error loading 'fall.wav': %s", Mix_GetError());
-		goto error_load_fall;
+	SDL_Log("Decoded sounds in %.1f ms", (SDL_GetPerformanceCounter()
+		- start) * 1000.0 / SDL_GetPerformanceFrequency());
+	return 0;
+}
+
+void start_loading_audio(void) {
+	sound_thread = SDL_CreateThread(load_sounds, "load_sounds", NULL);
+	if (sound_thread == NULL) {
+		// init_audio loads them itself.
+		SDL_Log("Unable to start sound thread: %s", SDL_GetError());
 	}
-	mix_chunk_hurt = load_sound("hurt.wav");
-	if (mix_chunk_hurt == NULL) {
-		SDL_Log("Error loading 'hurt.wav': %s", Mix_GetError());
-		goto error_load_hurt;
+}
+
+static i32 finish_loading_sounds(void) {
+	i32 result;
+	if (sound_thread) {
+		SDL_WaitThread(sound_thread, &result);
+		sound_thread = NULL;
+	} else {
+		result = load_sounds(NULL);
 	}
-	mix_chunk_victory = load_sound("victory.wav");
-	if (mix_chunk_victory == NULL) {
-		SDL_Log("Error loading 'victory.wav': %s", Mix_GetError());
-		goto error_load_victory;
+	return result;
+}
+
+void cancel_loading_audio(void) {
+	if (sound_thread) {
+		SDL_WaitThread(sound_thread, NULL);
+		sound_thread = NULL;
+		free_sounds();
+	}
+}
+
+i32 init_audio(void) {
+	if (finish_loading_sounds()) {
+		return 1;
 	}
 	Mix_AllocateChannels(16);
 	Mix_Volume(-1, MIX_MAX_VOLUME / 4);
 	return 0;
-
-error_load_victory:
-	Mix_FreeChunk(mix_chunk_hurt);
-error_load_hurt:
-	Mix_FreeChunk(mix_chunk_fall);
-error_load_fall:
-	Mix_FreeChunk(mix_chunk_heart);
-error_load_heart:
-	Mix_FreeChunk(mix_chunk_move);
-error_load_move:
-	return 1;
 }
 
 void quit_audio(void) {
-	Mix_FreeChunk(mix_chunk_move);
-	Mix_FreeChunk(mix_chunk_heart);
-	Mix_FreeChunk(mix_chunk_fall);
-	Mix_FreeChunk(mix_chunk_hurt);
-	Mix_FreeChunk(mix_chunk_victory);
+	free_sounds();
 }
 
 void play_sound(enum sound sound) {
-	switch (sound) {
-	case SOUND_MOVE:
-		Mix_PlayChannel(-1, mix_chunk_move, 0);
-		break;
-	case SOUND_HEART:
-		Mix_PlayChannel(-1, mix_chunk_heart, 0);
-		break;
-	case SOUND_FALL:
-		Mix_PlayChannel(-1, mix_chunk_fall, 0);
-		break;
-	case SOUND_HURT:
-		Mix_PlayChannel(-1, mix_chunk_hurt, 0);
-		break;
-	case SOUND_VICTORY:
-		Mix_PlayChannel(-1, mix_chunk_victory, 0);
-		break;
-	}
+	Mix_PlayChannel(-1, mix_chunks[sound], 0);
 }
@@ -0,0 +1,441 @@
+#include "bitboard.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+static inline void set_bit(u64 *words, u32 i) {
+	words[i >> 6] |= 1ull << (i & 63);
+}
+
+static inline void clear_bit(u64 *words, u32 i) {
+	words[i >> 6] &= ~(1ull << (i & 63));
+}
+
+static inline u32 test_bit(const u64 *words, u32 i) {
+	return (words[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline i32 in_box(const struct level_bits_static *st,
+		i32 x, i32 z) {
+	return x >= -BITS_MARGIN && x < (i32)st->width - BITS_MARGIN
+		&& z >= -BITS_MARGIN && z < (i32)st->height - BITS_MARGIN;
+}
+
+static inline u32 cell_bit(const struct level_bits_static *st, i32 x, i32 z) {
+	return (z + BITS_MARGIN) * st->width + x + BITS_MARGIN;
+}
+
+// Shifts a whole layer towards higher bits by n < 64.
+static void shift_up(const struct level_bits_static *st,
+		struct layer_bits *out, const struct layer_bits *in, u32 n) {
+	u64 carry = 0;
+	for (u32 i = 0; i < st->num_words; ++i) {
+		u64 w = in->words[i];
+		out->words[i] = (w << n) | carry;
+		carry = w >> (64 - n);
+	}
+}
+
+// Shifts a whole layer towards lower bits by n < 64.
+static void shift_down(const struct level_bits_static *st,
+		struct layer_bits *out, const struct layer_bits *in, u32 n) {
+	u64 carry = 0;
+	for (u32 i = st->num_words; i--;) {
+		u64 w = in->words[i];
+		out->words[i] = (w >> n) | carry;
+		carry = w << (64 - n);
+	}
+}
+
+i32 build_level_bits_static(struct level_bits_static *statics,
+		struct level *level) {
+	memset(statics, 0, sizeof(*statics));
+	statics->width  = level->width  + 2 * BITS_MARGIN;
+	statics->height = level->height + 2 * BITS_MARGIN;
+	statics->layers = level->layers;
+	statics->num_words = (statics->width * statics->height + 63) / 64;
+	statics->num_colors = level->num_colors;
+	if (level->num_colors > BITS_MAX_COLORS) {
+		return 1;
+	}
+	for (u32 z = 0; z < statics->height; ++z) {
+		for (u32 x = 0; x < statics->width; ++x) {
+			u32 i = z * statics->width + x;
+			set_bit(statics->in_box.words, i);
+			if (x) {
+				set_bit(statics->not_first_column.words, i);
+			}
+			if (x + 1 < statics->width) {
+				set_bit(statics->not_last_column.words, i);
+			}
+		}
+	}
+	for (u32 i = 1; i < level->num_blocks; ++i) {
+		struct block *b = &level->blocks[i];
+		if (b->type != BLOCK_TYPE_CUBE || b->cube.color) {
+			continue;
+		}
+		if (!in_box(statics, b->pos.x, b->pos.z)
+				|| b->pos.y < 0 || b->pos.y >= (i32)level->layers) {
+			return 1;
+		}
+		set_bit(statics->grey[b->pos.y].words,
+			cell_bit(statics, b->pos.x, b->pos.z));
+	}
+	return 0;
+}
+
+i32 build_level_bits(struct level_bits *bits,
+		const struct level_bits_static *statics, struct level *level) {
+	const struct level_bits_static *st = statics;
+	memset(bits, 0, sizeof(*bits));
+	bits->statics = statics;
+	for (u32 y = 0; y < st->layers; ++y) {
+		memcpy(bits_board(bits, BITS_BOARD_SOLID, y), st->grey[y].words,
+			st->num_words * sizeof(u64));
+	}
+	memcpy(bits->player_health, level->player_health,
+		sizeof(bits->player_health));
+	for (u32 i = 1; i < level->num_blocks; ++i) {
+		struct block *b = &level->blocks[i];
+		if (!in_box(st, b->pos.x, b->pos.z)
+				|| b->pos.y < 0 || b->pos.y >= (i32)st->layers) {
+			return 1;
+		}
+		u32 y = b->pos.y, bit = cell_bit(st, b->pos.x, b->pos.z);
+		switch (b->type) {
+		case BLOCK_TYPE_EMPTY:
+			break;
+		case BLOCK_TYPE_PLAYER:
+			bits->player.x = b->pos.x;
+			bits->player.y = b->pos.y;
+			bits->player.z = b->pos.z;
+			set_bit(bits_board(bits, BITS_BOARD_SOLID, y), bit);
+			break;
+		case BLOCK_TYPE_CUBE:
+			if (b->cube.color >= BITS_MAX_COLORS) {
+				return 1;
+			}
+			if (b->cube.color) {
+				set_bit(bits_board(bits,
+					BITS_BOARD_CUBES + b->cube.color, y), bit);
+				set_bit(bits_board(bits, BITS_BOARD_SOLID, y), bit);
+			}
+			break;
+		case BLOCK_TYPE_HEART:
+			if (b->heart.color >= BITS_MAX_COLORS) {
+				return 1;
+			}
+			set_bit(bits_board(bits,
+				BITS_BOARD_HEARTS + b->heart.color, y), bit);
+			break;
+		case BLOCK_TYPE_GOAL:
+			set_bit(bits_board(bits, BITS_BOARD_GOALS, y), bit);
+			break;
+		}
+	}
+	return 0;
+}
+
+void copy_level_bits(struct level_bits *dst, struct level_bits *src) {
+	const struct level_bits_static *st = src->statics;
+	memcpy(dst, src, offsetof(struct level_bits, words));
+	memcpy(dst->words, src->words,
+		BITS_NUM_BOARDS * st->layers * st->num_words * sizeof(u64));
+}
+
+// A block taking part in a move: the player, or a coloured cube.
+struct bits_block {
+	u8 is_player;
+	u8 color;
+	i8 x, y, z;
+};
+
+struct bits_move_ctx {
+	struct level_bits *bits;
+	u32 result;
+};
+
+static inline u32 is_solid(struct level_bits *bits, i32 x, i32 y, i32 z) {
+	const struct level_bits_static *st = bits->statics;
+	if (y < 0 || y >= (i32)st->layers || !in_box(st, x, z)) {
+		return 0;
+	}
+	return test_bit(bits_board(bits, BITS_BOARD_SOLID, y),
+		cell_bit(st, x, z));
+}
+
+// Colour of the coloured cube at a cell, or 0 if there isn't one.
+static u8 cube_color(struct level_bits *bits, i32 x, i32 y, i32 z) {
+	const struct level_bits_static *st = bits->statics;
+	if (!is_solid(bits, x, y, z)) {
+		return 0;
+	}
+	u32 bit = cell_bit(st, x, z);
+	for (u32 color = 1; color < BITS_MAX_COLORS; ++color) {
+		if (test_bit(bits_board(bits, BITS_BOARD_CUBES + color, y), bit)) {
+			return color;
+		}
+	}
+	return 0;
+}
+
+static void move_to(struct level_bits *bits, struct bits_block *b,
+		i8 x, i8 y, i8 z) {
+	const struct level_bits_static *st = bits->statics;
+	u32 from = cell_bit(st, b->x, b->z), to = cell_bit(st, x, z);
+	clear_bit(bits_board(bits, BITS_BOARD_SOLID, b->y), from);
+	set_bit(bits_board(bits, BITS_BOARD_SOLID, y), to);
+	if (b->is_player) {
+		bits->player.x = x;
+		bits->player.y = y;
+		bits->player.z = z;
+	} else {
+		clear_bit(bits_board(bits, BITS_BOARD_CUBES + b->color, b->y), from);
+		set_bit(bits_board(bits, BITS_BOARD_CUBES + b->color, y), to);
+	}
+	b->x = x;
+	b->y = y;
+	b->z = z;
+}
+
+static void lose_health_bits(struct bits_move_ctx *ctx,
+		struct bits_block *victim, u8 color, u8 amount) {
+	struct level_bits *bits = ctx->bits;
+	u32 num_colors = bits->statics->num_colors;
+	if (!victim->is_player) {
+		return;
+	}
+	u32 first = color ? color : 1;
+	u32 last  = color ? color + 1 : num_colors;
+	for (u32 i = first; i < last; ++i) {
+		ctx->result |= MOVE_RESULT_HEALTH_CHANGED;
+		if (bits->player_health[i] > amount) {
+			bits->player_health[i] -= amount;
+		} else {
+			bits->player_health[i] = 0;
+		}
+	}
+	u32 player_alive = 0;
+	for (u32 i = 1; i < num_colors; ++i) {
+		if (bits->player_health[i]) {
+			player_alive = 1;
+			break;
+		}
+	}
+	if (!player_alive) {
+		ctx->result |= MOVE_RESULT_DIED;
+	}
+}
+
+// Picks up whatever item is in the mover's new cell. Only the player gains
+// anything from it; cubes just destroy it.
+static void collect_bits(struct bits_move_ctx *ctx, struct bits_block *b) {
+	struct level_bits *bits = ctx->bits;
+	const struct level_bits_static *st = bits->statics;
+	u32 bit = cell_bit(st, b->x, b->z);
+	for (u32 color = 0; color < BITS_MAX_COLORS; ++color) {
+		u64 *hearts = bits_board(bits, BITS_BOARD_HEARTS + color, b->y);
+		if (test_bit(hearts, bit)) {
+			clear_bit(hearts, bit);
+			if (b->is_player) {
+				ctx->result |= MOVE_RESULT_HEALTH_CHANGED;
+				assert(bits->player_health[color] < 255);
+				++bits->player_health[color];
+			}
+			return;
+		}
+	}
+	u64 *goals = bits_board(bits, BITS_BOARD_GOALS, b->y);
+	if (test_bit(goals, bit)) {
+		clear_bit(goals, bit);
+		if (b->is_player) {
+			ctx->result |= MOVE_RESULT_WON;
+		}
+	}
+}
+
+// Marks the unbroken run of coloured cubes from (x, y, z) up as loose. They
+// rest on whatever is below the run, and fall with it, as do_fall's chain of
+// fallers does.
+static void mark_loose_run(struct level_bits *bits, struct layer_bits *loose,
+		i8 x, i8 y, i8 z) {
+	const struct level_bits_static *st = bits->statics;
+	while (cube_color(bits, x, y, z)) {
+		set_bit(loose[y].words, cell_bit(st, x, z));
+		++y;
+	}
+}
+
+// Drops every loose block with nothing solid under it by one layer, a whole
+// layer of words at a time, until they all rest on something or on the
+// bottom layer. Going up the layers lets a stack fall a layer per pass.
+static void drop_loose(struct level_bits *bits, struct layer_bits *loose) {
+	const struct level_bits_static *st = bits->statics;
+	u32 player_bit = cell_bit(st, bits->player.x, bits->player.z);
+	u64 dropped;
+	do {
+		dropped = 0;
+		for (u32 y = 1; y < st->layers; ++y) {
+			u64 *solid = bits_board(bits, BITS_BOARD_SOLID, y);
+			u64 *solid_below = bits_board(bits, BITS_BOARD_SOLID, y-1);
+			for (u32 i = 0; i < st->num_words; ++i) {
+				u64 f = loose[y].words[i] & ~solid_below[i];
+				if (!f) {
+					continue;
+				}
+				dropped |= f;
+				loose[y].words[i]   &= ~f;
+				loose[y-1].words[i] |= f;
+				solid[i]       &= ~f;
+				solid_below[i] |= f;
+				for (u32 color = 1; color < st->num_colors; ++color) {
+					u64 *cubes = bits_board(bits,
+						BITS_BOARD_CUBES + color, y);
+					u64 *cubes_below = bits_board(bits,
+						BITS_BOARD_CUBES + color, y-1);
+					cubes_below[i] |= cubes[i] & f;
+					cubes[i] &= ~f;
+				}
+				if (y == (u32)bits->player.y && i == player_bit >> 6
+						&& ((f >> (player_bit & 63)) & 1)) {
+					--bits->player.y;
+				}
+			}
+		}
+	} while (dropped);
+}
+
+// Health for the player having fallen from from_y to where it is now, as
+// do_fall deals it: a fall onto anything costs every colour the height
+// fallen, falling off the bottom kills, and landing on a coloured cube costs
+// its colour one.
+static void land_player(struct bits_move_ctx *ctx, i8 from_y) {
+	struct level_bits *bits = ctx->bits;
+	struct bits_block player = {
+		.is_player = 1,
+		.x = bits->player.x, .y = bits->player.y, .z = bits->player.z,
+	};
+	u32 fall_height = from_y - player.y;
+	if (fall_height) {
+		if (player.y == 0) {
+			ctx->result |= MOVE_RESULT_DIED;
+			return;
+		}
+		lose_health_bits(ctx, &player, 0, fall_height);
+	}
+	u8 color = cube_color(bits, player.x, player.y - 1, player.z);
+	if (color) {
+		lose_health_bits(ctx, &player, color, 1);
+	}
+}
+
+static void move_bits(struct bits_move_ctx *ctx, i8 dx, i8 dz) {
+	struct level_bits *bits = ctx->bits;
+	u8 health[BITS_MAX_COLORS];
+	memcpy(health, bits->player_health, sizeof(health));
+	struct bits_block mover = {
+		.is_player = 1,
+		.x = bits->player.x, .y = bits->player.y, .z = bits->player.z,
+	};
+	while (1) {
+		i8 ox = mover.x, oy = mover.y, oz = mover.z;
+		i8 x = ox + dx, z = oz + dz;
+		if (!in_box(bits->statics, x, z)) {
+			// Only bounces have happened so far, and they only
+			// touch health.
+			memcpy(bits->player_health, health, sizeof(health));
+			ctx->result = BITS_MOVE_OUT_OF_BOX;
+			return;
+		}
+		if (!is_solid(bits, x, oy, z)) {
+			ctx->result |= MOVE_RESULT_MOVED;
+			move_to(bits, &mover, x, oy, z);
+			collect_bits(ctx, &mover);
+			// The mover and what rests on it can fall, as can what
+			// rested on it where it came from.
+			struct layer_bits loose[MAX_LEVEL_LAYERS];
+			memset(loose, 0, bits->statics->layers * sizeof(loose[0]));
+			set_bit(loose[oy].words, cell_bit(bits->statics, x, z));
+			mark_loose_run(bits, loose, x, oy+1, z);
+			mark_loose_run(bits, loose, ox, oy+1, oz);
+			drop_loose(bits, loose);
+			if (mover.is_player) {
+				land_player(ctx, oy);
+			}
+			return;
+		}
+		u8 color = cube_color(bits, x, oy, z);
+		if (!color) {
+			return;
+		}
+		lose_health_bits(ctx, &mover, color, 1);
+		mover = (struct bits_block){
+			.color = color, .x = x, .y = oy, .z = z,
+		};
+	}
+}
+
+u32 play_move_bits(struct level_bits *bits, enum move move) {
+	struct bits_move_ctx ctx = {
+		.bits = bits,
+	};
+	switch (move) {
+	case MOVE_NONE:
+		break;
+	case MOVE_UP:
+		move_bits(&ctx, 0, 1);
+		break;
+	case MOVE_DOWN:
+		move_bits(&ctx, 0, -1);
+		break;
+	case MOVE_LEFT:
+		move_bits(&ctx, -1, 0);
+		break;
+	case MOVE_RIGHT:
+		move_bits(&ctx, 1, 0);
+		break;
+	}
+	return ctx.result;
+}
+
+void player_reachable_bits(struct level_bits *bits, struct layer_bits *out) {
+	const struct level_bits_static *st = bits->statics;
+	u32 n = st->num_words, y = bits->player.y;
+	memset(out, 0, sizeof(*out));
+	if (y == 0) {
+		return;
+	}
+	// Free cells are empty and have something under them to stand on.
+	u64 *below = bits_board(bits, BITS_BOARD_SOLID, y-1);
+	u64 *solid = bits_board(bits, BITS_BOARD_SOLID, y);
+	u64 *goals = bits_board(bits, BITS_BOARD_GOALS, y);
+	struct layer_bits free;
+	for (u32 i = 0; i < n; ++i) {
+		u64 items = goals[i];
+		for (u32 color = 0; color < BITS_MAX_COLORS; ++color) {
+			items |= bits_board(bits, BITS_BOARD_HEARTS + color, y)[i];
+		}
+		free.words[i] = st->in_box.words[i] & below[i] & ~solid[i]
+			& ~items;
+	}
+	set_bit(out->words, cell_bit(st, bits->player.x, bits->player.z));
+	struct layer_bits left, right, down, up;
+	u64 changed;
+	do {
+		shift_up(st, &right, out, 1);
+		shift_down(st, &left, out, 1);
+		shift_up(st, &up, out, st->width);
+		shift_down(st, &down, out, st->width);
+		changed = 0;
+		for (u32 i = 0; i < n; ++i) {
+			u64 grown = out->words[i] | (free.words[i]
+				& ((right.words[i] & st->not_first_column.words[i])
+				| (left.words[i] & st->not_last_column.words[i])
+				| up.words[i] | down.words[i]));
+			changed |= grown ^ out->words[i];
+			out->words[i] = grown;
+		}
+	} while (changed);
+}
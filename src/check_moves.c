@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "levels.h"
+#include "replay.h"
+
+#define DEFAULT_GAMES 1000
+#define DEFAULT_MOVES 200
+
+static u64 splitmix64(u64 *state) {
+	u64 z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+// Compares only what copy_level copies, field by field so padding in the
+// blocks doesn't count.
+static i32 levels_differ(struct level *a, struct level *b) {
+	if (a->num_blocks != b->num_blocks
+			|| a->num_block_ids != b->num_block_ids
+			|| a->player_slot != b->player_slot
+			|| a->num_offgrid_blocks != b->num_offgrid_blocks
+			|| memcmp(a->player_health, b->player_health,
+				sizeof(a->player_health)) != 0) {
+		return 1;
+	}
+	u32 num_cells = a->width * a->height * a->layers;
+	if (memcmp(a->grid, b->grid, num_cells * sizeof(a->grid[0])) != 0
+			|| memcmp(a->block_slots, b->block_slots,
+				a->num_block_ids * sizeof(a->block_slots[0])) != 0) {
+		return 1;
+	}
+	for (u32 i = 0; i < a->num_blocks; ++i) {
+		struct block *ba = &a->blocks[i], *bb = &b->blocks[i];
+		if (ba->block_id != bb->block_id || ba->type != bb->type
+				|| ba->pos.x != bb->pos.x || ba->pos.y != bb->pos.y
+				|| ba->pos.z != bb->pos.z
+				|| ba->cube.color != bb->cube.color) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static i32 bits_differ(struct level_bits *a, struct level_bits *b) {
+	const struct level_bits_static *st = a->statics;
+	return a->player.x != b->player.x || a->player.y != b->player.y
+		|| a->player.z != b->player.z
+		|| memcmp(a->player_health, b->player_health,
+			sizeof(a->player_health)) != 0
+		|| memcmp(a->words, b->words, BITS_NUM_BOARDS * st->layers
+			* st->num_words * sizeof(u64)) != 0;
+}
+
+// Checks player_reachable_bits against a flood fill over the level's blocks:
+// from the player, through cells on its layer holding no block, with a cube
+// or the player under them. Like player_reachable_bits, it finds nothing when
+// the player is on the bottom layer.
+static i32 reachable_differ(struct level_bits *bits, struct level *level) {
+	const struct level_bits_static *st = bits->statics;
+	enum { CELL_BLOCKED = 1, CELL_FLOOR = 2, CELL_SEEN = 4 };
+	static struct layer_bits reachable;
+	static u8 cells[BITS_MAX_WIDTH * BITS_MAX_HEIGHT];
+	static u16 queue[BITS_MAX_WIDTH * BITS_MAX_HEIGHT];
+	player_reachable_bits(bits, &reachable);
+	memset(cells, 0, sizeof(cells));
+	struct block *player = &level->blocks[level->player_slot];
+	i32 y = player->pos.y;
+	for (u32 i = 1; i < level->num_blocks; ++i) {
+		struct block *b = &level->blocks[i];
+		i32 x = b->pos.x + BITS_MARGIN, z = b->pos.z + BITS_MARGIN;
+		if (b->type == BLOCK_TYPE_EMPTY || x < 0 || x >= (i32)st->width
+				|| z < 0 || z >= (i32)st->height) {
+			continue;
+		}
+		if (b->pos.y == y && b != player) {
+			cells[z * st->width + x] |= CELL_BLOCKED;
+		}
+		if (b->pos.y == y - 1 && (b->type == BLOCK_TYPE_CUBE
+				|| b->type == BLOCK_TYPE_PLAYER)) {
+			cells[z * st->width + x] |= CELL_FLOOR;
+		}
+	}
+	u32 head = 0, tail = 0;
+	if (y > 0) {
+		u32 start = (player->pos.z + BITS_MARGIN) * st->width
+			+ player->pos.x + BITS_MARGIN;
+		cells[start] |= CELL_SEEN;
+		queue[tail++] = start;
+	}
+	while (head < tail) {
+		u32 cell = queue[head++];
+		i32 x = cell % st->width, z = cell / st->width;
+		static const i32 dx[4] = { 1, -1, 0, 0 }, dz[4] = { 0, 0, 1, -1 };
+		for (u32 d = 0; d < 4; ++d) {
+			i32 nx = x + dx[d], nz = z + dz[d];
+			if (nx < 0 || nx >= (i32)st->width
+					|| nz < 0 || nz >= (i32)st->height) {
+				continue;
+			}
+			u32 next = nz * st->width + nx;
+			if ((cells[next] & (CELL_BLOCKED | CELL_FLOOR | CELL_SEEN))
+					== CELL_FLOOR) {
+				cells[next] |= CELL_SEEN;
+				queue[tail++] = next;
+			}
+		}
+	}
+	for (u32 i = 0; i < st->width * st->height; ++i) {
+		u32 seen = (cells[i] & CELL_SEEN) != 0;
+		if (seen != ((reachable.words[i >> 6] >> (i & 63)) & 1)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static struct level start, slow, fast;
+static struct event events[MAX_EVENTS];
+static struct level_bits_static statics;
+static struct level_bits bits, before, expected_bits;
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-b] [-r replay_file] [-g games] [-m moves] "
+		"[-s seed] [-l pack] [level]\n"
+		"  -b  also play every move on a bitboard state and check "
+		"the cells\n      the player can reach\n"
+		"  -r  record every game, as the game does, for replayer\n"
+		"  -g  games a level, defaults to %u\n"
+		"  -m  most moves a game, defaults to %u\n"
+		"  -s  seed for the random moves\n"
+		"  -l  level pack, defaults to " DEFAULT_LEVEL_PACK "\n",
+		name, DEFAULT_GAMES, DEFAULT_MOVES);
+}
+
+// Plays random moves on every level in the pack, or just the one given, with
+// both play_move and play_move_fast, and checks that they reach the same
+// level and that the fast path's result matches the events. Both run the same
+// apply_move, so this only checks what the fast path does differently: the
+// result mask it keeps instead of events, and copy_level. Rules that drift in
+// apply_move itself are caught by -b and by replaying recordings made with
+// an older build.
+//
+// With -b, the moves are also played with play_move_bits, a separate
+// implementation of the rules whose state has to match one built from
+// play_move's level, and player_reachable_bits has to match a flood fill over
+// the level before every move. A game starts over once the player wins or
+// dies, or a move leaves the bitboard's box.
+//
+// With -r, every game is also recorded from play_move's events the way the
+// game records attempts, so replayer can check multi-move recordings.
+i32 main(i32 argc, char *argv[]) {
+	u32 first = 0, last = ~0u;
+	u32 num_games = DEFAULT_GAMES, max_moves = DEFAULT_MOVES;
+	u64 rng = 1;
+	u8 check_bits = 0;
+	const char *replay_path = NULL;
+	const char *pack_path = DEFAULT_LEVEL_PACK;
+	i32 opt;
+	while ((opt = getopt(argc, argv, "br:g:m:s:l:")) != -1) {
+		switch (opt) {
+		case 'b':
+			check_bits = 1;
+			break;
+		case 'r':
+			replay_path = optarg;
+			break;
+		case 'g':
+			num_games = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			max_moves = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			rng = strtoull(optarg, NULL, 10);
+			break;
+		case 'l':
+			pack_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind < argc) {
+		first = last = strtoul(argv[optind], NULL, 10);
+	}
+	enum level_pack_error error = open_levels(pack_path);
+	if (error != LEVEL_PACK_OK) {
+		fprintf(stderr, "%s: %s\n", pack_path,
+			level_pack_error_string(error));
+		return EXIT_FAILURE;
+	}
+
+	FILE *replay_file = NULL;
+	if (replay_path) {
+		replay_file = fopen(replay_path, "wb");
+		if (replay_file == NULL) {
+			fprintf(stderr, "%s: can't open file\n", replay_path);
+			close_levels();
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct replay replay;
+	init_replay(&replay, 0, 0);
+	u64 num_moves = 0, num_failed = 0, num_out_of_box = 0;
+	for (u32 n = first; n <= last && n < num_pack_levels(); ++n) {
+		error = build_level(&start, n);
+		if (error != LEVEL_PACK_OK) {
+			fprintf(stderr, "level %u: %s\n", n,
+				level_pack_error_string(error));
+			++num_failed;
+			continue;
+		}
+		u8 level_bits = check_bits;
+		if (level_bits && (build_level_bits_static(&statics, &start)
+				|| build_level_bits(&bits, &statics, &start))) {
+			fprintf(stderr, "level %u: no bitboard for it\n", n);
+			++num_failed;
+			level_bits = 0;
+		}
+		for (u32 g = 0; g < num_games; ++g) {
+			copy_level(&slow, &start);
+			copy_level(&fast, &start);
+			if (level_bits) {
+				build_level_bits(&bits, &statics, &start);
+			}
+			free_replay(&replay);
+			init_replay(&replay, n, g);
+			for (u32 m = 0; m < max_moves; ++m) {
+				if (level_bits && reachable_differ(&bits, &slow)) {
+					fprintf(stderr, "level %u, game %u, move %u: "
+						"reachable cells differ\n", n, g, m);
+					++num_failed;
+					break;
+				}
+				enum move move = MOVE_UP + splitmix64(&rng) % 4;
+				u32 num_events = 0;
+				play_move(&slow, &num_events, events, move);
+				u32 expected = events_result(events, num_events);
+				if (replay_file && record_move(&replay, move, events,
+						num_events)) {
+					fprintf(stderr, "out of memory\n");
+					return EXIT_FAILURE;
+				}
+				u32 result = play_move_fast(&fast, move);
+				++num_moves;
+				if (result != expected || levels_differ(&slow, &fast)) {
+					fprintf(stderr, "level %u, game %u, move %u: "
+						"result %#x, events give %#x%s\n", n, g, m,
+						result, expected,
+						levels_differ(&slow, &fast)
+							? ", levels differ" : "");
+					++num_failed;
+					break;
+				}
+				if (level_bits) {
+					copy_level_bits(&before, &bits);
+					u32 bits_result = play_move_bits(&bits, move);
+					if (bits_result == BITS_MOVE_OUT_OF_BOX) {
+						if (bits_differ(&bits, &before)) {
+							fprintf(stderr, "level %u, game %u, "
+								"move %u: state changed leaving "
+								"the box\n", n, g, m);
+							++num_failed;
+						}
+						++num_out_of_box;
+						break;
+					}
+					if (build_level_bits(&expected_bits, &statics,
+							&slow)) {
+						fprintf(stderr, "level %u, game %u, move %u: "
+							"block left the box unnoticed\n",
+							n, g, m);
+						++num_failed;
+						break;
+					}
+					if (bits_result != expected
+							|| bits_differ(&bits, &expected_bits)) {
+						fprintf(stderr, "level %u, game %u, move %u: "
+							"bitboard result %#x, events give %#x%s\n",
+							n, g, m, bits_result, expected,
+							bits_differ(&bits, &expected_bits)
+								? ", states differ" : "");
+						++num_failed;
+						break;
+					}
+				}
+				if (result & (MOVE_RESULT_WON | MOVE_RESULT_DIED)) {
+					break;
+				}
+			}
+			if (replay_file && write_replay(replay_file, &replay)) {
+				fprintf(stderr, "%s: can't write replay\n",
+					replay_path);
+				++num_failed;
+			}
+		}
+	}
+	close_levels();
+	free_replay(&replay);
+	if (replay_file && fclose(replay_file)) {
+		fprintf(stderr, "%s: can't write replay\n", replay_path);
+		++num_failed;
+	}
+
+	printf("%llu moves, %llu mismatches", (unsigned long long)num_moves,
+		(unsigned long long)num_failed);
+	if (check_bits) {
+		printf(", %llu games left the bitboard's box",
+			(unsigned long long)num_out_of_box);
+	}
+	printf("\n");
+	return num_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
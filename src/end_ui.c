@@ -8,6 +8,13 @@ void run_end_ui(SDL_Window *window) {
 	f32 end_time = start_time + 3.0f;
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	reset_characters();
+	add_text("Thank you",
+		(struct color) { .r = 0.75f, .g = 0.75f, .b = 0.75f },
+		6.0f, 4.0f, -3.0f);
+	add_text("  for playing.",
+		(struct color) { .r = 0.75f, .g = 0.75f, .b = 0.75f },
+		6.0f, 4.0f, -4.0f);
 	while (1) {
 		SDL_Event e;
 		while (SDL_PollEvent(&e)) {
@@ -38,13 +45,6 @@ void run_end_ui(SDL_Window *window) {
 		set_fade_color(fr, fg, fb, fade);
 
 		glClear(GL_COLOR_BUFFER_BIT);
-		reset_characters();
-		add_string("Thank you",
-			(struct color) { .r = 0.75f, .g = 0.75f, .b = 0.75f },
-			6.0f, 4.0f, -3.0f);
-		add_string("  for playing.",
-			(struct color) { .r = 0.75f, .g = 0.75f, .b = 0.75f },
-			6.0f, 4.0f, -4.0f);
 		draw_characters();
 		draw_fade();
 		SDL_GL_SwapWindow(window);
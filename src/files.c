@@ -0,0 +1,45 @@
+#include "files.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+i32 map_file(const char *path, struct mapped_file *file) {
+	i32 result = 1;
+	i32 fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		goto error_open;
+	}
+	struct stat st;
+	if (fstat(fd, &st)) {
+		goto error_stat;
+	}
+	file->data = NULL;
+	file->size = st.st_size;
+	if (file->size) {
+		void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			goto error_stat;
+		}
+		file->data = data;
+	}
+	result = 0;
+error_stat: {
+	// The mapping outlives the descriptor.
+	i32 saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+}
+error_open:
+	return result;
+}
+
+void unmap_file(struct mapped_file *file) {
+	if (file->data) {
+		munmap((void *)file->data, file->size);
+	}
+	file->data = NULL;
+	file->size = 0;
+}
@@ -1,7 +1,8 @@
 #include "game.h"
 
 #include <assert.h>
-#include <SDL.h>
+#include <stddef.h>
+#include <string.h>
 
 void reset_level(struct level *level) {
 	level->width      = 0;
@@ -12,10 +13,97 @@ void reset_level(struct level *level) {
 		.type     = BLOCK_TYPE_EMPTY,
 		.block_id = 0,
 	};
+	level->num_block_ids  = 1;
+	level->block_slots[0] = 0;
+	level->player_slot    = 0;
 	for (u32 i = 0; i < MAX_COLORS; ++i) {
 		level->color_map[i] = (struct color){.r=0.0f,.g=0.0f,.b=0.0f};
 		level->player_health[i] = 0;
 	}
+	memset(level->grid, 0, sizeof(level->grid));
+	level->num_offgrid_blocks = 0;
+}
+
+void copy_level(struct level *dst, struct level *src) {
+	memcpy(dst, src, offsetof(struct level, grid));
+	memcpy(dst->grid, src->grid, src->width * src->height * src->layers
+		* sizeof(src->grid[0]));
+	memcpy(dst->block_slots, src->block_slots,
+		src->num_block_ids * sizeof(src->block_slots[0]));
+	memcpy(dst->blocks, src->blocks,
+		src->num_blocks * sizeof(src->blocks[0]));
+}
+
+static u16 *grid_cell(struct level *level, i8 x, i8 y, i8 z) {
+	if (x < 0 || x >= (i32)level->width
+			|| y < 0 || y >= (i32)level->layers
+			|| z < 0 || z >= (i32)level->height) {
+		return NULL;
+	}
+	return &level->grid[(y * level->height + z) * level->width + x];
+}
+
+static void grid_insert(struct level *level, u32 slot) {
+	struct block *b = &level->blocks[slot];
+	u16 *cell = grid_cell(level, b->pos.x, b->pos.y, b->pos.z);
+	if (cell == NULL) {
+		++level->num_offgrid_blocks;
+		return;
+	}
+	*cell = *cell ? GRID_SHARED : slot;
+}
+
+static void grid_remove(struct level *level, u32 slot) {
+	struct block *b = &level->blocks[slot];
+	u16 *cell = grid_cell(level, b->pos.x, b->pos.y, b->pos.z);
+	if (cell == NULL) {
+		--level->num_offgrid_blocks;
+		return;
+	}
+	if (*cell != GRID_SHARED) {
+		*cell = 0;
+		return;
+	}
+	u32 num_left = 0, left = 0;
+	for (u32 i = 1; i < level->num_blocks; ++i) {
+		struct block *o = &level->blocks[i];
+		if (i != slot && o->pos.x == b->pos.x && o->pos.y == b->pos.y
+				&& o->pos.z == b->pos.z) {
+			++num_left;
+			left = i;
+		}
+	}
+	assert(num_left);
+	if (num_left == 1) {
+		*cell = left;
+	}
+}
+
+static void set_block_pos(struct level *level, struct block *b,
+		i8 x, i8 y, i8 z) {
+	u32 slot = b - level->blocks;
+	grid_remove(level, slot);
+	b->pos.x = x;
+	b->pos.y = y;
+	b->pos.z = z;
+	grid_insert(level, slot);
+}
+
+static void push_block(struct level *level, struct block block) {
+	u32 slot = level->num_blocks++;
+	level->blocks[slot] = block;
+	level->block_slots[block.block_id] = slot;
+	level->num_block_ids = MAX(level->num_block_ids, block.block_id + 1);
+	if (block.type == BLOCK_TYPE_PLAYER) {
+		level->player_slot = slot;
+	}
+	grid_insert(level, slot);
+}
+
+void add_block(struct level *level, struct block block) {
+	assert(level->num_blocks < MAX_BLOCKS);
+	block.block_id = level->num_blocks;
+	push_block(level, block);
 }
 
 static void level_add_block(struct level *level, char block_char,
@@ -38,7 +126,7 @@ static void level_add_block(struct level *level, char block_char,
 		case '3': block.cube.color = 3; break;
 		}
 		block.block_id = level->num_blocks;
-		level->blocks[level->num_blocks++] = block;
+		push_block(level, block);
 	} break;
 	case '@': {
 		assert(level->num_blocks < MAX_BLOCKS);
@@ -48,7 +136,7 @@ static void level_add_block(struct level *level, char block_char,
 		block.pos.y = y;
 		block.pos.z = z;
 		block.block_id = level->num_blocks;
-		level->blocks[level->num_blocks++] = block;
+		push_block(level, block);
 	} break;
 	case 'a':
 	case 'b':
@@ -65,7 +153,7 @@ static void level_add_block(struct level *level, char block_char,
 		case 'c': block.heart.color = 3; break;
 		}
 		block.block_id = level->num_blocks;
-		level->blocks[level->num_blocks++] = block;
+		push_block(level, block);
 	} break;
 	case '!': {
 		assert(level->num_blocks < MAX_BLOCKS);
@@ -75,7 +163,7 @@ static void level_add_block(struct level *level, char block_char,
 		block.pos.y = y;
 		block.pos.z = z;
 		block.block_id = level->num_blocks;
-		level->blocks[level->num_blocks++] = block;
+		push_block(level, block);
 	}
 	}
 }
@@ -100,16 +188,23 @@ struct block_pos {
 };
 
 static struct block *get_player(struct level *level) {
-	for (u32 i = 0; i < level->num_blocks; ++i) {
-		struct block *b = &level->blocks[i];
-		if (b->type == BLOCK_TYPE_PLAYER) {
-			return b;
-		}
-	}
-	assert(0);
+	assert(level->player_slot);
+	return &level->blocks[level->player_slot];
+}
+
+static struct block *get_block_by_id(struct level *level, u32 block_id) {
+	return &level->blocks[level->block_slots[block_id]];
 }
 
 static struct block *block_in_pos(struct level *level, i8 x, i8 y, i8 z) {
+	u16 *cell = grid_cell(level, x, y, z);
+	if (cell == NULL) {
+		if (level->num_offgrid_blocks == 0) {
+			return &level->blocks[0];
+		}
+	} else if (*cell != GRID_SHARED) {
+		return &level->blocks[*cell];
+	}
 	for (u32 i = 0; i < level->num_blocks; ++i) {
 		struct block *b = &level->blocks[i];
 		if (b->type == BLOCK_TYPE_EMPTY) {
@@ -122,13 +217,24 @@ static struct block *block_in_pos(struct level *level, i8 x, i8 y, i8 z) {
 	return &level->blocks[0];
 }
 
-static void delete_block_by_id(struct level *level, u32 block_id) {
-	for (u32 i = 0; i < level->num_blocks; ++i) {
-		if (level->blocks[i].block_id == block_id) {
-			level->blocks[i] = level->blocks[--level->num_blocks];
-			return;
+void move_block_by_id(struct level *level, u32 block_id, i8 x, i8 y, i8 z) {
+	set_block_pos(level, get_block_by_id(level, block_id), x, y, z);
+}
+
+void delete_block_by_id(struct level *level, u32 block_id) {
+	u32 i = level->block_slots[block_id];
+	u32 last = level->num_blocks - 1;
+	grid_remove(level, i);
+	if (i != last) {
+		grid_remove(level, last);
+		level->blocks[i] = level->blocks[last];
+		level->block_slots[level->blocks[i].block_id] = i;
+		if (level->player_slot == last) {
+			level->player_slot = i;
 		}
+		grid_insert(level, i);
 	}
+	level->num_blocks = last;
 }
 
 static inline u32 can_walk_through(enum block_type type) {
@@ -145,19 +251,52 @@ static inline u32 can_walk_through(enum block_type type) {
 	return 0;
 }
 
+struct move_ctx {
+	struct level *level;
+	u32 *num_events_out;
+	struct event *events_out;
+	// Events are written here instead when events_out is NULL.
+	struct event scratch;
+	u32 result;
+};
+
+static struct event *new_event(struct move_ctx *ctx, u32 type) {
+	switch (type) {
+	case EVENT_TYPE_MOVE:
+	case EVENT_TYPE_FALL:
+		ctx->result |= MOVE_RESULT_MOVED;
+		break;
+	case EVENT_TYPE_WIN:
+		ctx->result |= MOVE_RESULT_WON;
+		break;
+	case EVENT_TYPE_DEATH:
+		ctx->result |= MOVE_RESULT_DIED;
+		break;
+	case EVENT_TYPE_LOSE_HEALTH:
+	case EVENT_TYPE_GAIN_HEALTH:
+		ctx->result |= MOVE_RESULT_HEALTH_CHANGED;
+		break;
+	}
+	struct event *e = &ctx->scratch;
+	if (ctx->events_out) {
+		assert(*ctx->num_events_out < MAX_EVENTS);
+		e = &ctx->events_out[*ctx->num_events_out];
+		++(*ctx->num_events_out);
+	}
+	e->type = type;
+	return e;
+}
+
 static void gain_health(
-		struct level *level,
-		u32 *num_events_out,
-		struct event *events_out,
+		struct move_ctx *ctx,
 		f32 time,
 		struct block *recipient,
 		u8 color, u8 amount) {
+	struct level *level = ctx->level;
 	if (recipient->type != BLOCK_TYPE_PLAYER) {
 		return;
 	}
-	struct event *e = &events_out[*num_events_out];
-	++(*num_events_out);
-	e->type       = EVENT_TYPE_GAIN_HEALTH;
+	struct event *e = new_event(ctx, EVENT_TYPE_GAIN_HEALTH);
 	e->block_id   = recipient->block_id;
 	e->start_time = time;
 	e->duration   = HEALTH_ANIM_DURATION;
@@ -183,23 +322,17 @@ static inline u32 is_collectable(enum block_type type) {
 }
 
 static void collect(
-		struct level *level,
-		u32 *num_events_out,
-		struct event *events_out,
+		struct move_ctx *ctx,
 		f32 time,
 		struct block *actor,
 		struct block *block) {
 	struct block collected = *block;
-	delete_block_by_id(level, collected.block_id);
-	struct event e;
-	e.type       = EVENT_TYPE_COLLECTED;
-	e.block_id   = collected.block_id;
-	e.start_time = time;
-	e.duration   = COLLECT_DURATION;
-	e.collect.block_type = collected.type;
-	assert(*num_events_out < MAX_EVENTS);
-	events_out[*num_events_out] = e;
-	++(*num_events_out);
+	delete_block_by_id(ctx->level, collected.block_id);
+	struct event *e = new_event(ctx, EVENT_TYPE_COLLECTED);
+	e->block_id   = collected.block_id;
+	e->start_time = time;
+	e->duration   = COLLECT_DURATION;
+	e->collect.block_type = collected.type;
 	if (actor->type == BLOCK_TYPE_PLAYER) {
 		switch (collected.type) {
 		case BLOCK_TYPE_EMPTY:
@@ -209,40 +342,32 @@ static void collect(
 			break;
 		case BLOCK_TYPE_HEART:
 			// TODO -- add player health
-			gain_health(level, num_events_out, events_out,
-				time, actor, collected.heart.color, 1);
+			gain_health(ctx, time, actor, collected.heart.color, 1);
+			break;
+		case BLOCK_TYPE_GOAL:
+			e = new_event(ctx, EVENT_TYPE_WIN);
+			e->block_id = 0;
+			e->start_time = time + COLLECT_DURATION;
+			e->duration   = FADE_DURATION;
 			break;
-		case BLOCK_TYPE_GOAL: {
-			struct event e;
-			e.type = EVENT_TYPE_WIN;
-			e.block_id = 0;
-			e.start_time = time + COLLECT_DURATION;
-			e.duration   = FADE_DURATION;
-			assert(*num_events_out < MAX_EVENTS);
-			events_out[*num_events_out] = e;
-			++(*num_events_out);
-		} break;
 
 		}
 	}
 }
 
 static void lose_health(
-		struct level *level,
-		u32 *num_events_out,
-		struct event *events_out,
+		struct move_ctx *ctx,
 		f32 time,
 		struct block *victim,
 		u8 color, u8 amount) {
+	struct level *level = ctx->level;
 	if (victim->type != BLOCK_TYPE_PLAYER) {
 		return;
 	}
 	struct event *e;
 	if (color == 0) {
 		for (u32 i = 1; i < level->num_colors; ++i) {
-			e = &events_out[*num_events_out];
-			++(*num_events_out);
-			e->type = EVENT_TYPE_LOSE_HEALTH;
+			e = new_event(ctx, EVENT_TYPE_LOSE_HEALTH);
 			e->block_id = victim->block_id;
 			e->start_time = time;
 			e->duration   = HEALTH_ANIM_DURATION;
@@ -256,9 +381,7 @@ static void lose_health(
 			e->lose_health.new_amount = level->player_health[i];
 		}
 	} else {
-		e = &events_out[*num_events_out];
-		++(*num_events_out);
-		e->type = EVENT_TYPE_LOSE_HEALTH;
+		e = new_event(ctx, EVENT_TYPE_LOSE_HEALTH);
 		e->block_id = victim->block_id;
 		e->start_time = time;
 		e->duration   = HEALTH_ANIM_DURATION;
@@ -279,134 +402,158 @@ static void lose_health(
 		}
 	}
 	if (!player_alive) {
-		e = &events_out[*num_events_out];
-		++(*num_events_out);
-		e->type = EVENT_TYPE_DEATH;
+		e = new_event(ctx, EVENT_TYPE_DEATH);
+		e->block_id = 0;
 		e->start_time = time + HEALTH_ANIM_DURATION;
 		e->duration = FADE_DURATION;
 	}
 }
 
-static void do_fall(
-		struct level *level,
-		u32 *num_events_out,
-		struct event *events_out,
-		f32 time, struct block *faller) {
-	i8 ox = faller->pos.x, oy = faller->pos.y, oz = faller->pos.z;
-	i8 x = ox, y = oy, z = oz;
-	u32 fall_height = 0;
-	f32 fall_duration = 0.0f;
-	struct block *b;
-	struct event *e;
-	do {
-		--y; ++fall_height;
-		b = block_in_pos(level, x, y, z);
-		// TODO -- add collection while falling through items
-	} while (y >= 0 && can_walk_through(b->type));
-	--fall_height;
-	if (fall_height) {
-		e = &events_out[*num_events_out];
-		++(*num_events_out);
-		e->type = EVENT_TYPE_FALL;
-		e->block_id = faller->block_id;
-		e->start_time = time;
-		fall_duration = ((f32)fall_height) / FALL_SPEED;
-		e->duration   = fall_duration;
-		e->fall.x = x;
-		e->fall.y = y+1;
-		e->fall.z = z;
-		faller->pos.x = x;
-		faller->pos.y = y+1;
-		faller->pos.z = z;
-		if (y < 0 && faller->type == BLOCK_TYPE_PLAYER) {
-			e = &events_out[*num_events_out];
-			++(*num_events_out);
-			e->type = EVENT_TYPE_DEATH;
-			e->start_time = time + fall_duration;
-			e->duration = FADE_DURATION;
+static void do_fall(struct move_ctx *ctx, f32 time, struct block *faller) {
+	struct level *level = ctx->level;
+	// A fall uncovers the cube above the faller's origin, which falls in
+	// turn and lands on top of it, and so on up the column. Landing damage
+	// is only dealt once the whole column has settled, last faller first.
+	struct {
+		struct block *faller, *landed_on;
+		f32 time;
+	} landings[MAX_LEVEL_LAYERS + 1];
+	u32 num_landings = 0;
+	struct block *prev = NULL;
+	while (faller) {
+		i8 ox = faller->pos.x, oy = faller->pos.y, oz = faller->pos.z;
+		i8 x = ox, y, z = oz;
+		f32 fall_duration = 0.0f;
+		struct block *b;
+		struct event *e;
+		if (prev && (b = block_in_pos(level, x, prev->pos.y, z)) == prev) {
+			// The previous faller just passed through every cell
+			// between here and where it landed.
+			y = prev->pos.y;
+		} else {
+			y = oy;
+			do {
+				--y;
+				b = block_in_pos(level, x, y, z);
+				// TODO -- add collection while falling through items
+			} while (y >= 0 && can_walk_through(b->type));
 		}
-		if (b->type != BLOCK_TYPE_EMPTY) {
-			lose_health(level, num_events_out, events_out,
-				time + fall_duration,
-				faller, 0, fall_height);
+		u32 fall_height = oy - y - 1;
+		if (fall_height) {
+			e = new_event(ctx, EVENT_TYPE_FALL);
+			e->block_id = faller->block_id;
+			e->start_time = time;
+			fall_duration = ((f32)fall_height) / FALL_SPEED;
+			e->duration   = fall_duration;
+			e->fall.x = x;
+			e->fall.y = y+1;
+			e->fall.z = z;
+			set_block_pos(level, faller, x, y+1, z);
+			if (y < 0 && faller->type == BLOCK_TYPE_PLAYER) {
+				e = new_event(ctx, EVENT_TYPE_DEATH);
+				e->block_id = 0;
+				e->start_time = time + fall_duration;
+				e->duration = FADE_DURATION;
+			}
+			if (b->type != BLOCK_TYPE_EMPTY) {
+				lose_health(ctx, time + fall_duration,
+					faller, 0, fall_height);
+			}
 		}
-		struct block *above = block_in_pos(level, ox, oy+1, oz);
-		if (above->type == BLOCK_TYPE_CUBE && above->cube.color) {
-			do_fall(level, num_events_out, events_out,
-				time + BETWEEN_FALL_DELAY, above);
+		assert(num_landings < ARRAY_LENGTH(landings));
+		landings[num_landings].faller    = faller;
+		landings[num_landings].landed_on = b;
+		landings[num_landings].time      = time + fall_duration;
+		++num_landings;
+		prev = faller;
+		faller = NULL;
+		if (fall_height) {
+			struct block *above = block_in_pos(level, ox, oy+1, oz);
+			if (above->type == BLOCK_TYPE_CUBE && above->cube.color) {
+				faller = above;
+				time += BETWEEN_FALL_DELAY;
+			}
 		}
 	}
-	if (b->type != BLOCK_TYPE_EMPTY) {
-		switch (b->type) {
-		case BLOCK_TYPE_CUBE:
-			if (b->cube.color) {
-				lose_health(level, num_events_out,
-					events_out, time + fall_duration,
-					faller, b->cube.color, 1);
-			}
-			break;
+	while (num_landings--) {
+		struct block *b = landings[num_landings].landed_on;
+		if (b->type == BLOCK_TYPE_CUBE && b->cube.color) {
+			lose_health(ctx, landings[num_landings].time,
+				landings[num_landings].faller, b->cube.color, 1);
 		}
 	}
 }
 
 static void do_move(
-		struct level *level,
-		u32 *num_events_out,
-		struct event *events_out,
+		struct move_ctx *ctx,
 		f32 time,
 		struct block *mover, i8 dx, i8 dy, i8 dz) {
-	i8 ox = mover->pos.x, oy = mover->pos.y, oz = mover->pos.z;
-	i8 x = ox + dx, y = oy + dy, z = oz + dz;
-	struct block *b = block_in_pos(level, x, y, z);
-	if (can_walk_through(b->type)) {
-		struct event *e = &events_out[*num_events_out];
-		++(*num_events_out);
-		e->type = EVENT_TYPE_MOVE;
-		e->block_id = mover->block_id;
-		e->start_time = time;
-		e->duration = MOVE_DURATION;
-		e->move.is_player = (mover->type == BLOCK_TYPE_PLAYER) ? 1 : 0;
-		e->move.x = x;
-		e->move.y = y;
-		e->move.z = z;
-		mover->pos.x = x;
-		mover->pos.y = y;
-		mover->pos.z = z;
-		if (is_collectable(b->type)) {
-			collect(level, num_events_out, events_out, time,
-				mover, b);
-		}
-		do_fall(level, num_events_out, events_out,
-			time + MOVE_DURATION, mover);
-		b = block_in_pos(level, ox, oy+1, oz);
-		if (b->type == BLOCK_TYPE_CUBE && b->cube.color) {
-			do_fall(level, num_events_out, events_out,
-				time + MOVE_DURATION, b);
+	struct level *level = ctx->level;
+	// Bumping into a coloured cube pushes it in turn, so a row of cubes is
+	// resolved one cube further along on each iteration.
+	while (1) {
+		i8 ox = mover->pos.x, oy = mover->pos.y, oz = mover->pos.z;
+		i8 x = ox + dx, y = oy + dy, z = oz + dz;
+		struct block *b = block_in_pos(level, x, y, z);
+		struct event *e;
+		if (can_walk_through(b->type)) {
+			e = new_event(ctx, EVENT_TYPE_MOVE);
+			e->block_id = mover->block_id;
+			e->start_time = time;
+			e->duration = MOVE_DURATION;
+			e->move.is_player
+				= (mover->type == BLOCK_TYPE_PLAYER) ? 1 : 0;
+			e->move.x = x;
+			e->move.y = y;
+			e->move.z = z;
+			set_block_pos(level, mover, x, y, z);
+			if (is_collectable(b->type)) {
+				u32 mover_id = mover->block_id;
+				collect(ctx, time, mover, b);
+				// Collecting swap-removes b, which may move the
+				// mover.
+				mover = get_block_by_id(level, mover_id);
+			}
+			do_fall(ctx, time + MOVE_DURATION, mover);
+			b = block_in_pos(level, ox, oy+1, oz);
+			if (b->type == BLOCK_TYPE_CUBE && b->cube.color) {
+				do_fall(ctx, time + MOVE_DURATION, b);
+			}
+			return;
 		}
-
-	} else {
-		struct event *e = &events_out[*num_events_out];
-		++(*num_events_out);
-		e->type = EVENT_TYPE_BOUNCE;
+		e = new_event(ctx, EVENT_TYPE_BOUNCE);
 		e->block_id = mover->block_id;
 		e->start_time = time;
 		e->duration = BOUNCE_DURATION;
 		e->bounce.dx = dx;
 		e->bounce.dy = dy;
 		e->bounce.dz = dz;
-		switch (b->type) {
-		case BLOCK_TYPE_CUBE:
-			// TODO -- check for pushing cube
-			if (b->cube.color) {
-				lose_health(level, num_events_out, events_out,
-					time + BOUNCE_DURATION / 2.0f,
-					mover, b->cube.color, 1);
-				do_move(level, num_events_out, events_out,
-					time + BOUNCE_DURATION / 2.0f,
-					b, dx, dy, dz);
-			}
-			break;
+		if (b->type != BLOCK_TYPE_CUBE || !b->cube.color) {
+			return;
 		}
+		lose_health(ctx, time + BOUNCE_DURATION / 2.0f,
+			mover, b->cube.color, 1);
+		time += BOUNCE_DURATION / 2.0f;
+		mover = b;
+	}
+}
+
+static void apply_move(struct move_ctx *ctx, enum move move) {
+	switch (move) {
+	case MOVE_NONE:
+		break;
+	case MOVE_UP:
+		do_move(ctx, 0.0f, get_player(ctx->level), 0, 0, 1);
+		break;
+	case MOVE_DOWN:
+		do_move(ctx, 0.0f, get_player(ctx->level), 0, 0, -1);
+		break;
+	case MOVE_LEFT:
+		do_move(ctx, 0.0f, get_player(ctx->level), -1, 0, 0);
+		break;
+	case MOVE_RIGHT:
+		do_move(ctx, 0.0f, get_player(ctx->level), 1, 0, 0);
+		break;
 	}
 }
 
@@ -415,28 +562,18 @@ void play_move(
 		u32 *num_events_out,
 		struct event *events_out,
 		enum move move) {
-	switch (move) {
-	case MOVE_NONE:
-		break;
-	case MOVE_UP: {
-		struct block *player = get_player(level);
-		do_move(level, num_events_out, events_out, 0.0f,
-			player, 0, 0, 1);
-	} break;
-	case MOVE_DOWN: {
-		struct block *player = get_player(level);
-		do_move(level, num_events_out, events_out, 0.0f,
-			player, 0, 0, -1);
-	} break;
-	case MOVE_LEFT: {
-		struct block *player = get_player(level);
-		do_move(level, num_events_out, events_out, 0.0f,
-			player, -1, 0, 0);
-	} break;
-	case MOVE_RIGHT: {
-		struct block *player = get_player(level);
-		do_move(level, num_events_out, events_out, 0.0f,
-			player, 1, 0, 0);
-	} break;
-	}
+	struct move_ctx ctx = {
+		.level          = level,
+		.num_events_out = num_events_out,
+		.events_out     = events_out,
+	};
+	apply_move(&ctx, move);
+}
+
+u32 play_move_fast(struct level *level, enum move move) {
+	struct move_ctx ctx = {
+		.level = level,
+	};
+	apply_move(&ctx, move);
+	return ctx.result;
 }
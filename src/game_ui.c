@@ -9,6 +9,7 @@
 #include "gl_3_3.h"
 #include "opengl.h"
 #include "audio.h"
+#include "animators.h"
 
 #define PI 3.14159265358979f
 
@@ -27,70 +28,89 @@ enum program_state {
 static enum program_state cur_state;
 static enum outcome program_outcome;
 
-enum item_animator_state {
-	ITEM_STATE_IDLE,
-	ITEM_STATE_BOBBING,
-	ITEM_STATE_MOVING,
-	ITEM_STATE_COLLECTING,
-	ITEM_STATE_FALLING,
-	ITEM_STATE_REBOUND,
-};
+// Frames a second drawn while waiting for input, unless LD44_IDLE_FPS says
+// otherwise. 0 draws every frame.
+#define DEFAULT_IDLE_FPS 15
 
-static u32 num_item_animators;
-struct item_animator {
-	enum item_animator_state state;
-	struct {
-		f32 x, y, z;
-	} pos;
-	u32 block_id;
-	struct color color;
-	u8 is_char;
-	u8 character;
-	union {
-		struct {
-			struct {
-				f32 mag, off, freq;
-			} x_disp, y_disp, z_disp;
-		} idle;
-		struct {
-			f32 mag, off, freq;
-		} bobbing;
-		struct {
-			f32 start_time, duration;
-			f32 sx, sy, sz;
-			f32 ex, ey, ez;
-		} moving;
-		struct {
-			f32 start_time, duration;
-			f32 dx, dy, dz;
-		} rebound;
-		struct {
-			f32 start_time, duration;
-		} collecting;
-		struct {
-			f32 start_time, duration;
-			f32 sx, sy, sz;
-			f32 ex, ey, ez;
-		} falling;
-	};
-};
-static struct item_animator item_animators[MAX_ITEMS];
+static u32 idle_frame_ms;
+
+// Seconds between render stats reports, when render debug logging is on.
+#define RENDER_STATS_PERIOD 1.0f
+
+// A frame that takes longer than one and a half at 60 Hz has missed a vsync.
+#define DROPPED_FRAME_MS 25.0f
+
+static f32 render_stats_start;
+static u32 render_stats_frames;
+// Time between swaps, over every frame not held back for idle. Carries on
+// from one level to the next, so transitions are counted too.
+static u64 last_swap;
+static f32 longest_frame_ms;
+static u32 dropped_frames;
+
+static f32 ticks_to_ms(u64 ticks) {
+	return ticks * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void report_render_stats(f32 time, u8 waited) {
+	u64 now = SDL_GetPerformanceCounter();
+	if (last_swap && !waited) {
+		f32 frame_ms = ticks_to_ms(now - last_swap);
+		longest_frame_ms = MAX(longest_frame_ms, frame_ms);
+		if (frame_ms > DROPPED_FRAME_MS) {
+			++dropped_frames;
+		}
+	}
+	last_swap = now;
+	++render_stats_frames;
+	if (time - render_stats_start < RENDER_STATS_PERIOD) {
+		return;
+	}
+	struct render_stats stats = take_render_stats();
+	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER,
+		"%u frames: %.1f draws, %.0f triangles, %.0f bytes, "
+		"%.2f uploads, %.2f sync waits per frame, "
+		"longest %.1f ms, %u dropped",
+		render_stats_frames,
+		(f32)stats.draw_calls / render_stats_frames,
+		(f64)stats.triangles / render_stats_frames,
+		(f64)stats.bytes_uploaded / render_stats_frames,
+		(f32)stats.uploads / render_stats_frames,
+		(f32)stats.sync_waits / render_stats_frames,
+		longest_frame_ms, dropped_frames);
+	render_stats_start = time;
+	render_stats_frames = 0;
+	longest_frame_ms = 0.0f;
+	dropped_frames = 0;
+}
+
+// The vertex shaders animate each block's instance; these only track where
+// blocks end up and when their animations finish.
+static struct animators item_animators;
 
 // static u32 num_health_animators;
+// The font shader does the flashing, so the label is only touched when the
+// amount changes.
 struct health_animator {
-	enum {
-		HEALTH_ANIM_IDLE,
-		HEALTH_ANIM_FLASHING,
-	} state;
 	u8 amount;
+	u32 label;
+	struct color color;
 	char text[MAX_HEALTH_TEXT];
-	union {
-		struct {
-			f32 start_time, duration;
-		} flashing;
-	};
 };
 struct health_animator health_animators[MAX_COLORS];
+// When the last health flash ends. Flashes are drawn at the full frame rate.
+static f32 flashing_until;
+
+static void set_health(struct health_animator *ha, u8 amount,
+		f32 start_time) {
+	ha->amount = amount;
+	snprintf(ha->text, sizeof(ha->text), "\003: %hhu", ha->amount);
+	set_text(ha->label, ha->text, ha->color);
+	flash_text(ha->label, start_time, HEALTH_ANIM_DURATION,
+		NUM_HEALTH_FLASHES);
+	flashing_until = MAX(flashing_until,
+		start_time + HEALTH_ANIM_DURATION);
+}
 
 static struct {
 	f32 start_time, duration;
@@ -102,34 +122,284 @@ static struct {
 	} end_color;
 } fade_animator;
 
-static u32 num_events;
+// The events of the last move played. Each move's are scheduled and then
+// dropped before the next.
 static struct event events[MAX_EVENTS];
 
-static struct item_animator *get_item_animator_by_id(u32 block_id) {
-	for (u32 i = 0; i < num_item_animators; ++i) {
-		if (item_animators[i].block_id == block_id) {
-			return &item_animators[i];
+// Events waiting to start, as a binary min-heap on start time. Events that
+// start together keep the order play_move gave them.
+struct scheduled_event {
+	struct event event;
+	u32 seq;
+};
+static u32 num_scheduled, next_seq;
+static struct scheduled_event scheduled[MAX_EVENTS];
+
+static i32 scheduled_before(struct scheduled_event *a,
+		struct scheduled_event *b) {
+	if (a->event.start_time != b->event.start_time) {
+		return a->event.start_time < b->event.start_time;
+	}
+	return a->seq < b->seq;
+}
+
+static void schedule_event(struct event e) {
+	assert(num_scheduled < MAX_EVENTS);
+	struct scheduled_event se = { .event = e, .seq = next_seq++ };
+	u32 i = num_scheduled++;
+	while (i > 0) {
+		u32 parent = (i - 1) / 2;
+		if (!scheduled_before(&se, &scheduled[parent])) {
+			break;
 		}
+		scheduled[i] = scheduled[parent];
+		i = parent;
 	}
-	return NULL;
+	scheduled[i] = se;
 }
 
-static void set_item_animator_state(
-		struct item_animator *ia,
-		enum item_animator_state new_state) {
-	ia->state = new_state;
-	switch (new_state) {
-	case ITEM_STATE_IDLE:
-		ia->idle.x_disp.mag  = rand_f32(0.025f, 0.05f);
-		ia->idle.x_disp.off  = rand_f32(0.0f, 2.0f*PI);
-		ia->idle.x_disp.freq = rand_f32(0.75f, 1.5f);
-		ia->idle.y_disp.mag  = rand_f32(0.025f, 0.05f);
-		ia->idle.y_disp.off  = rand_f32(0.0f, 2.0f*PI);
-		ia->idle.y_disp.freq = rand_f32(0.75f, 1.5f);
-		ia->idle.z_disp.mag  = rand_f32(0.025f, 0.05f);
-		ia->idle.z_disp.off  = rand_f32(0.0f, 2.0f*PI);
-		ia->idle.z_disp.freq = rand_f32(0.75f, 1.5f);
-		break;
+static struct event pop_scheduled_event(void) {
+	assert(num_scheduled > 0);
+	struct event top = scheduled[0].event;
+	struct scheduled_event last = scheduled[--num_scheduled];
+	u32 i = 0;
+	while (1) {
+		u32 child = 2 * i + 1;
+		if (child >= num_scheduled) {
+			break;
+		}
+		if (child + 1 < num_scheduled
+				&& scheduled_before(&scheduled[child + 1],
+					&scheduled[child])) {
+			++child;
+		}
+		if (!scheduled_before(&scheduled[child], &last)) {
+			break;
+		}
+		scheduled[i] = scheduled[child];
+		i = child;
+	}
+	scheduled[i] = last;
+	return top;
+}
+
+// A block as the level starts, with the colour and idle motion it's drawn with.
+struct scene_block {
+	struct block block;
+	struct color color;
+	u8 is_char, character;
+	struct idle_params idle;
+};
+
+// An attempt at a level, built and laid out by prepare_scene. The static
+// cubes are also baked into the next static mesh, so only the uploads are
+// left for run_game_ui.
+struct level_scene {
+	u32 level_num, seed;
+	enum level_pack_error error;
+	struct level level;
+	u32 num_blocks;
+	struct scene_block blocks[MAX_BLOCKS];
+	u32 num_static_cubes;
+	struct static_cube_params static_cubes[MAX_CUBES];
+};
+
+// The scene being played, and the one prepared for after it. The worker only
+// touches next_scene, and nothing else calls rand while it runs.
+static struct level_scene scenes[2];
+static struct level_scene *cur_scene  = &scenes[0];
+static struct level_scene *next_scene = &scenes[1];
+static SDL_Thread *scene_thread;
+
+i32 init_game_ui(void) {
+	u32 idle_fps = DEFAULT_IDLE_FPS;
+	const char *idle_fps_env = getenv("LD44_IDLE_FPS");
+	if (idle_fps_env) {
+		idle_fps = strtoul(idle_fps_env, NULL, 10);
+	}
+	idle_frame_ms = idle_fps ? 1000 / idle_fps : 0;
+	return init_animators(&item_animators, MAX_BLOCKS);
+}
+
+void quit_game_ui(void) {
+	if (scene_thread) {
+		SDL_WaitThread(scene_thread, NULL);
+		scene_thread = NULL;
+	}
+	free_animators(&item_animators);
+}
+
+static struct idle_params wobble_idle(void) {
+	struct idle_params idle;
+	idle.mag.x  = rand_f32(0.025f, 0.05f);
+	idle.off.x  = rand_f32(0.0f, 2.0f*PI);
+	idle.freq.x = rand_f32(0.75f, 1.5f);
+	idle.mag.y  = rand_f32(0.025f, 0.05f);
+	idle.off.y  = rand_f32(0.0f, 2.0f*PI);
+	idle.freq.y = rand_f32(0.75f, 1.5f);
+	idle.mag.z  = rand_f32(0.025f, 0.05f);
+	idle.off.z  = rand_f32(0.0f, 2.0f*PI);
+	idle.freq.z = rand_f32(0.75f, 1.5f);
+	return idle;
+}
+
+static struct idle_params bobbing_idle(void) {
+	struct idle_params idle = { 0 };
+	idle.mag.y  = rand_f32(0.2f, 0.3f);
+	idle.off.y  = rand_f32(0.0f, 2.0f*PI);
+	idle.freq.y = rand_f32(1.0f, 1.5f);
+	return idle;
+}
+
+static void add_scene_block(struct level_scene *scene, struct block block,
+		struct color color, u8 is_char, u8 character,
+		struct idle_params idle) {
+	scene->blocks[scene->num_blocks++] = (struct scene_block){
+		.block = block,
+		.color = color,
+		.is_char = is_char,
+		.character = character,
+		.idle = idle,
+	};
+}
+
+// Draws colours and idle motions in the same order as they always have been,
+// so a replay's seed gives the same animations.
+static void prepare_scene(struct level_scene *scene, u32 level_num) {
+	struct level *level = &scene->level;
+	scene->level_num = level_num;
+	scene->num_blocks = 0;
+	scene->num_static_cubes = 0;
+	scene->error = build_level(level, level_num);
+	if (scene->error != LEVEL_PACK_OK) {
+		return;
+	}
+	// Reseed per attempt so a replay also pins down the animations.
+	scene->seed = rand();
+	srand(scene->seed);
+	for (u32 i = 0; i < level->num_blocks; ++i) {
+		struct block block = level->blocks[i];
+		switch (block.type) {
+		case BLOCK_TYPE_EMPTY:
+			break;
+		case BLOCK_TYPE_PLAYER:
+			add_scene_block(scene, block, level->player_color,
+				1, (u8)'\002', wobble_idle());
+			break;
+		case BLOCK_TYPE_CUBE: {
+			struct color color = level->color_map[block.cube.color];
+			f32 variation = rand_f32(-0.08f, 0.08f);
+			color.r += variation;
+			color.g += variation;
+			color.b += variation;
+			// Only coloured cubes are ever pushed or fall.
+			if (block.cube.color == 0) {
+				scene->static_cubes[scene->num_static_cubes++]
+					= (struct static_cube_params){
+						.r = color.r,
+						.g = color.g,
+						.b = color.b,
+						.x = block.pos.x,
+						.y = block.pos.y,
+						.z = block.pos.z,
+					};
+			} else {
+				add_scene_block(scene, block, color, 0, 0,
+					wobble_idle());
+			}
+		} break;
+		case BLOCK_TYPE_HEART:
+			add_scene_block(scene, block,
+				level->color_map[block.heart.color],
+				1, (u8)'\003', bobbing_idle());
+			break;
+		case BLOCK_TYPE_GOAL:
+			add_scene_block(scene, block, level->goal_color,
+				1, (u8)'!', bobbing_idle());
+			break;
+		}
+	}
+	bake_next_static_cubes(scene->static_cubes, scene->num_static_cubes,
+		level->camera);
+}
+
+static i32 prepare_scene_thread(void *data) {
+	prepare_scene(next_scene, *(u32 *)data);
+	return 0;
+}
+
+void prepare_level(u32 level_num) {
+	static u32 thread_level_num;
+	if (scene_thread) {
+		// A death after a win, or the other way round. Waiting here would
+		// stall the fade out, so wait_for_level finds the scene is for the
+		// wrong level and prepares the right one once the fade is over.
+		return;
+	}
+	thread_level_num = level_num;
+	scene_thread = SDL_CreateThread(prepare_scene_thread, "prepare_level",
+		&thread_level_num);
+	if (scene_thread == NULL) {
+		// wait_for_level prepares it itself.
+		SDL_Log("Unable to start level thread: %s", SDL_GetError());
+	}
+}
+
+enum level_pack_error wait_for_level(u32 level_num, u32 *seed) {
+	u8 prepared = 0;
+	if (scene_thread) {
+		SDL_WaitThread(scene_thread, NULL);
+		scene_thread = NULL;
+		prepared = next_scene->level_num == level_num;
+	}
+	if (!prepared) {
+		prepare_scene(next_scene, level_num);
+	}
+	struct level_scene *scene = cur_scene;
+	cur_scene = next_scene;
+	next_scene = scene;
+	*seed = cur_scene->seed;
+	return cur_scene->error;
+}
+
+static void add_block_animator(struct block block, struct color color,
+		u8 is_char, u8 character, struct idle_params idle) {
+	f32 x = (f32)block.pos.x, y = (f32)block.pos.y, z = (f32)block.pos.z;
+	struct motion_params motion = { .type = MOTION_IDLE };
+	u32 instance;
+	if (is_char) {
+		instance = add_item((struct item_params){
+			.r = color.r, .g = color.g, .b = color.b,
+			.x = x, .y = y, .z = z,
+			.character = character,
+			.idle = idle,
+			.motion = motion,
+		});
+	} else {
+		instance = add_cube((struct cube_params){
+			.r = color.r, .g = color.g, .b = color.b,
+			.x = x, .y = y, .z = z,
+			.idle = idle,
+			.motion = motion,
+		});
+	}
+	add_animator(&item_animators, block.block_id, instance, is_char,
+		x, y, z, idle);
+}
+
+// Moves the block's animator into group and hands the event's timing to its
+// instance. (x, y, z) is as for start_animator.
+static void start_motion(struct event e, enum anim_group group,
+		f32 x, f32 y, f32 z) {
+	struct anim_entry entry;
+	struct motion_params motion = start_animator(&item_animators,
+		e.block_id, group, e.start_time, e.duration, x, y, z, &entry);
+	if (entry.is_char) {
+		set_item_motion(entry.instance,
+			entry.x, entry.y, entry.z, motion);
+	} else {
+		set_cube_motion(entry.instance,
+			entry.x, entry.y, entry.z, motion);
 	}
 }
 
@@ -139,44 +409,22 @@ static void start_animation(struct event e) {
 		if (e.move.is_player) {
 			play_sound(SOUND_MOVE);
 		}
-		struct item_animator *ia = get_item_animator_by_id(e.block_id);
-		assert(ia);
-		ia->state = ITEM_STATE_MOVING;
-		ia->moving.sx = ia->pos.x;
-		ia->moving.sy = ia->pos.y;
-		ia->moving.sz = ia->pos.z;
-		ia->moving.ex = e.move.x;
-		ia->moving.ey = e.move.y;
-		ia->moving.ez = e.move.z;
-		ia->pos.x = e.move.x;
-		ia->pos.y = e.move.y;
-		ia->pos.z = e.move.z;
-		ia->moving.start_time = e.start_time;
-		ia->moving.duration   = e.duration;
-	} break;
-	case EVENT_TYPE_BOUNCE: {
-		struct item_animator *ia = get_item_animator_by_id(e.block_id);
-		assert(ia);
-		ia->state = ITEM_STATE_REBOUND;
-		ia->rebound.dx = e.bounce.dx;
-		ia->rebound.dy = e.bounce.dy;
-		ia->rebound.dz = e.bounce.dz;
-		ia->rebound.start_time = e.start_time;
-		ia->rebound.duration   = e.duration;
+		start_motion(e, ANIM_MOVING, e.move.x, e.move.y, e.move.z);
 	} break;
+	case EVENT_TYPE_BOUNCE:
+		start_motion(e, ANIM_REBOUND,
+			e.bounce.dx, e.bounce.dy, e.bounce.dz);
+		break;
 	case EVENT_TYPE_COLLECTED: {
 		if (e.collect.block_type == BLOCK_TYPE_HEART) {
 			play_sound(SOUND_HEART);
 		}
-		struct item_animator *ia = get_item_animator_by_id(e.block_id);
-		assert(ia);
-		ia->state = ITEM_STATE_COLLECTING;
-		ia->collecting.start_time = e.start_time;
-		ia->collecting.duration   = e.duration;
+		start_motion(e, ANIM_COLLECTING, 0.0f, 0.0f, 0.0f);
 	} break;
 	case EVENT_TYPE_WIN:
 		play_sound(SOUND_VICTORY);
 		program_outcome = OUTCOME_SUCCESS;
+		prepare_level(cur_scene->level_num + 1);
 		cur_state = STATE_FADE_OUT;
 		fade_animator.start_time    = e.start_time;
 		fade_animator.duration      = e.duration;
@@ -191,6 +439,7 @@ static void start_animation(struct event e) {
 		break;
 	case EVENT_TYPE_DEATH:
 		program_outcome = OUTCOME_DEATH;
+		prepare_level(cur_scene->level_num);
 		cur_state = STATE_FADE_OUT;
 		fade_animator.start_time    = e.start_time;
 		fade_animator.duration      = e.duration;
@@ -203,46 +452,60 @@ static void start_animation(struct event e) {
 		fade_animator.end_color.g   = 0.0f;
 		fade_animator.end_color.a   = 1.0f;
 		break;
-	case EVENT_TYPE_FALL: {
-		struct item_animator *ia = get_item_animator_by_id(e.block_id);
-		assert(ia);
-		ia->state = ITEM_STATE_FALLING;
-		ia->falling.start_time = e.start_time;
-		ia->falling.duration   = e.duration;
-		ia->falling.sx = ia->pos.x;
-		ia->falling.sy = ia->pos.y;
-		ia->falling.sz = ia->pos.z;
-		ia->falling.ex = e.fall.x;
-		ia->falling.ey = e.fall.y;
-		ia->falling.ez = e.fall.z;
-		ia->pos.x = e.fall.x;
-		ia->pos.y = e.fall.y;
-		ia->pos.z = e.fall.z;
-	} break;
-	case EVENT_TYPE_LOSE_HEALTH: {
+	case EVENT_TYPE_FALL:
+		start_motion(e, ANIM_FALLING, e.fall.x, e.fall.y, e.fall.z);
+		break;
+	case EVENT_TYPE_LOSE_HEALTH:
 		play_sound(SOUND_HURT);
-		struct health_animator *ha
-			= &health_animators[e.lose_health.color];
-		ha->state = HEALTH_ANIM_FLASHING;
-		ha->amount = e.lose_health.new_amount;
-		ha->flashing.start_time = e.start_time;
-		ha->flashing.duration   = HEALTH_ANIM_DURATION;
-	} break;
-	case EVENT_TYPE_GAIN_HEALTH: {
-		struct health_animator *ha
-			= &health_animators[e.gain_health.color];
-		ha->state = HEALTH_ANIM_FLASHING;
-		ha->amount = e.gain_health.new_amount;
-		ha->flashing.start_time = e.start_time;
-		ha->flashing.duration   = HEALTH_ANIM_DURATION;
-	} break;
+		set_health(&health_animators[e.lose_health.color],
+			e.lose_health.new_amount, e.start_time);
+		break;
+	case EVENT_TYPE_GAIN_HEALTH:
+		set_health(&health_animators[e.gain_health.color],
+			e.gain_health.new_amount, e.start_time);
+		break;
 
 	}
 }
 
-enum outcome run_game_ui(SDL_Window *window, struct level *level) {
-	num_item_animators = 0;
-	num_events = 0;
+// Returns non-zero if the player asked to quit.
+static i32 handle_event(SDL_Event *e, enum move *next_move) {
+	switch (e->type) {
+	case SDL_QUIT:
+		return 1;
+	case SDL_KEYUP:
+		switch (e->key.keysym.sym) {
+		case SDLK_q:
+			return 1;
+		}
+		break;
+	case SDL_KEYDOWN:
+		switch (e->key.keysym.sym) {
+		case SDLK_UP:
+			*next_move = MOVE_UP;
+			break;
+		case SDLK_DOWN:
+			*next_move = MOVE_DOWN;
+			break;
+		case SDLK_LEFT:
+			*next_move = MOVE_LEFT;
+			break;
+		case SDLK_RIGHT:
+			*next_move = MOVE_RIGHT;
+			break;
+		}
+		break;
+	}
+	return 0;
+}
+
+enum outcome run_game_ui(SDL_Window *window, struct replay *replay) {
+	struct level *level = &cur_scene->level;
+	u64 handoff_start = SDL_GetPerformanceCounter();
+	reset_animators(&item_animators);
+	num_scheduled = 0;
+	next_seq = 0;
+	flashing_until = 0.0f;
 
 	cur_state = STATE_FADE_IN;
 	fade_animator.start_time    = ((f32)SDL_GetTicks()) / 1000.0f;
@@ -258,197 +521,97 @@ enum outcome run_game_ui(SDL_Window *window, struct level *level) {
 	// cur_state = STATE_AWAITING_INPUT;
 	program_outcome = OUTCOME_QUIT;
 
-	// Init anim state
-	for (u32 i = 0; i < level->num_blocks; ++i) {
-		struct block block = level->blocks[i];
-		switch (block.type) {
-		case BLOCK_TYPE_EMPTY:
-			break;
-		case BLOCK_TYPE_PLAYER: {
-			struct item_animator ia;
-			ia.block_id = block.block_id;
-			ia.is_char = 1;
-			ia.pos.x = (f32)block.pos.x;
-			ia.pos.y = (f32)block.pos.y;
-			ia.pos.z = (f32)block.pos.z;
-			ia.color = level->player_color;
-			ia.character = (u8)'\002';
-			set_item_animator_state(&ia, ITEM_STATE_IDLE);
-			item_animators[num_item_animators++] = ia;
-		} break;
-		case BLOCK_TYPE_CUBE: {
-			struct item_animator ia;
-			ia.block_id = block.block_id;
-			ia.is_char = 0;
-			ia.pos.x = (f32)block.pos.x;
-			ia.pos.y = (f32)block.pos.y;
-			ia.pos.z = (f32)block.pos.z;
-			ia.color = level->color_map[block.cube.color];
-			f32 variation = rand_f32(-0.08f, 0.08f);
-			ia.color.r += variation;
-			ia.color.g += variation;
-			ia.color.b += variation;
-			set_item_animator_state(&ia, ITEM_STATE_IDLE);
-			item_animators[num_item_animators++] = ia;
-		} break;
-		case BLOCK_TYPE_HEART: {
-			struct item_animator ia;
-			ia.block_id = block.block_id;
-			ia.is_char = 1;
-			ia.state = ITEM_STATE_BOBBING;
-			ia.pos.x = (f32)block.pos.x;
-			ia.pos.y = (f32)block.pos.y;
-			ia.pos.z = (f32)block.pos.z;
-
-			ia.color = level->color_map[block.heart.color];
-			ia.character = (u8)'\003';
-
-			ia.bobbing.mag  = rand_f32(0.2f, 0.3f);
-			ia.bobbing.off  = rand_f32(0.0f, 2.0f*PI);
-			ia.bobbing.freq = rand_f32(1.0f, 1.5f);
-			item_animators[num_item_animators++] = ia;
-		} break;
-		case BLOCK_TYPE_GOAL: {
-			struct item_animator ia;
-			ia.block_id = block.block_id;
-			ia.is_char = 1;
-			ia.state = ITEM_STATE_BOBBING;
-			ia.pos.x = (f32)block.pos.x;
-			ia.pos.y = (f32)block.pos.y;
-			ia.pos.z = (f32)block.pos.z;
-
-			ia.color = level->goal_color;
-			ia.character = (u8)'!';
-
-			ia.bobbing.mag  = rand_f32(0.2f, 0.3f);
-			ia.bobbing.off  = rand_f32(0.0f, 2.0f*PI);
-			ia.bobbing.freq = rand_f32(1.0f, 1.5f);
-			item_animators[num_item_animators++] = ia;
-		} break;
-		}
+	// Init anim state, from the scene prepared during the last fade out.
+	reset_cubes();
+	reset_items();
+	for (u32 i = 0; i < cur_scene->num_blocks; ++i) {
+		struct scene_block *sb = &cur_scene->blocks[i];
+		add_block_animator(sb->block, sb->color, sb->is_char,
+			sb->character, sb->idle);
 	}
+	use_next_static_cubes();
+	reset_characters();
 	for (u32 i = 0; i < level->num_colors; ++i) {
 		struct health_animator *ha = &health_animators[i];
 		ha->amount = level->player_health[i];
+		ha->color = level->color_map[i];
+		snprintf(ha->text, sizeof(ha->text), "\003: %hhu", ha->amount);
+		// Colour 0 is grey, which the player has no health in.
+		if (i > 0) {
+			ha->label = add_text(ha->text, ha->color,
+				4.0f, 2.0f, -((f32)i));
+		}
 	}
 
+	set_camera(level->camera);
 	glClearColor(level->background_color.r, level->background_color.g,
 		level->background_color.b, 1.0f);
+	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER, "Level %u handed off in %.2f ms",
+		cur_scene->level_num,
+		ticks_to_ms(SDL_GetPerformanceCounter() - handoff_start));
+	u32 last_frame_ticks = SDL_GetTicks();
 	while (cur_state != STATE_FINISHED) {
 		SDL_Event e;
 		enum move next_move = MOVE_NONE;
+		u8 waited = 0;
+		// Nothing but the idle wobble moves while waiting for input,
+		// so frames are spaced out until an event arrives.
+		if (cur_state == STATE_AWAITING_INPUT && idle_frame_ms
+				&& SDL_GetTicks() / 1000.0f > flashing_until) {
+			i32 wait = (i32)(last_frame_ticks + idle_frame_ms
+				- SDL_GetTicks());
+			waited = wait > 0;
+			if (wait > 0 && SDL_WaitEventTimeout(&e, wait)
+					&& handle_event(&e, &next_move)) {
+				return OUTCOME_QUIT;
+			}
+		}
+		last_frame_ticks = SDL_GetTicks();
 		while (SDL_PollEvent(&e)) {
-			switch (e.type) {
-			case SDL_QUIT:
+			if (handle_event(&e, &next_move)) {
 				return OUTCOME_QUIT;
-			case SDL_KEYUP:
-				switch (e.key.keysym.sym) {
-				case SDLK_q:
-					return OUTCOME_QUIT;
-				}
-				break;
-			case SDL_KEYDOWN:
-				switch (e.key.keysym.sym) {
-				case SDLK_UP:
-					next_move = MOVE_UP;
-					break;
-				case SDLK_DOWN:
-					next_move = MOVE_DOWN;
-					break;
-				case SDLK_LEFT:
-					next_move = MOVE_LEFT;
-					break;
-				case SDLK_RIGHT:
-					next_move = MOVE_RIGHT;
-					break;
-				}
-				break;
 			}
 		}
 
 		f32 time = ((f32)SDL_GetTicks()) / 1000.0f;
 		if (next_move != MOVE_NONE
 				&& cur_state == STATE_AWAITING_INPUT) {
+			u32 num_events = 0;
 			play_move(level, &num_events, events, next_move);
+			if (replay && record_move(replay, next_move,
+					events, num_events)) {
+				SDL_Log("Out of memory recording replay");
+				replay = NULL;
+			}
 			if (num_events) {
 				cur_state = STATE_ANIMATING;
 				for (u32 i = 0; i < num_events; ++i) {
 					events[i].start_time += time;
+					schedule_event(events[i]);
 				}
 			}
 		}
 
 		if (cur_state == STATE_ANIMATING) {
 			enum program_state next_state = STATE_AWAITING_INPUT;
-			if (num_events) {
+			// Everything due is started, in order, even if a long
+			// frame means it has already finished.
+			while (num_scheduled
+					&& time > scheduled[0].event.start_time) {
+				start_animation(pop_scheduled_event());
+			}
+			if (num_scheduled) {
 				next_state = STATE_ANIMATING;
 			}
-			u32 i = 0;
-			while (i < num_events) {
-				struct event e = events[i];
-				if (time > e.start_time + e.duration) {
-					events[i] = events[--num_events];
-					continue;
-				}
-				if (time > e.start_time) {
-					events[i] = events[--num_events];
-					start_animation(e);
-					continue;
-				}
-				++i;
+			// Finished motions fall back to idle in the shaders
+			// by themselves; nothing is uploaded.
+			u32 num_landed = 0;
+			if (update_animators(&item_animators,
+					time, &num_landed)) {
+				next_state = STATE_ANIMATING;
 			}
-			i = 0;
-			while (i < num_item_animators) {
-				struct item_animator *ia
-					= &item_animators[i];
-				switch (ia->state) {
-				case ITEM_STATE_IDLE:
-				case ITEM_STATE_BOBBING:
-					break;
-				case ITEM_STATE_MOVING:
-					if (time > ia->moving.start_time
-						+ ia->moving.duration) {
-
-						set_item_animator_state(
-							ia, ITEM_STATE_IDLE);
-					} else {
-						next_state = STATE_ANIMATING;
-					}
-					break;
-				case ITEM_STATE_REBOUND:
-					if (time > ia->rebound.start_time
-						+ ia->rebound.duration) {
-						set_item_animator_state(
-							ia, ITEM_STATE_IDLE);
-					} else {
-						next_state = STATE_ANIMATING;
-					}
-					break;
-				case ITEM_STATE_COLLECTING:
-					if (time > ia->collecting.start_time
-						+ ia->collecting.duration) {
-
-						item_animators[i]
-							= item_animators[
-							--num_item_animators];
-						continue;
-					} else {
-						next_state = STATE_ANIMATING;
-					}
-					break;
-				case ITEM_STATE_FALLING:
-					if (time > ia->falling.start_time
-						+ ia->falling.duration) {
-
-						play_sound(SOUND_FALL);
-						set_item_animator_state(
-							ia, ITEM_STATE_IDLE);
-					} else {
-						next_state = STATE_ANIMATING;
-					}
-					break;
-				}
-				++i;
+			for (u32 j = 0; j < num_landed; ++j) {
+				play_sound(SOUND_FALL);
 			}
 			if (cur_state != STATE_FADE_OUT) {
 				cur_state = next_state;
@@ -466,114 +629,8 @@ enum outcome run_game_ui(SDL_Window *window, struct level *level) {
 		}
 
 		// Draw
-		// glClear();
-		reset_cubes();
-		reset_items();
-		for (u32 i = 0; i < num_item_animators; ++i) {
-			struct item_animator ia = item_animators[i];
-			struct item_params params;
-			params.r = ia.color.r;
-			params.g = ia.color.g;
-			params.b = ia.color.b;
-			params.x = ia.pos.x;
-			params.y = ia.pos.y;
-			params.z = ia.pos.z;
-			// SDL_Log("%f %f %f", params.x, params.y, params.z);
-			params.character = ia.character;
-			switch (ia.state) {
-			case ITEM_STATE_IDLE:
-				params.x += ia.idle.x_disp.mag*(
-					sin(ia.idle.x_disp.off
-						+ ia.idle.x_disp.freq*time));
-				params.y += ia.idle.y_disp.mag*(
-					sin(ia.idle.y_disp.off
-						+ ia.idle.y_disp.freq*time));
-				params.z += ia.idle.z_disp.mag*(
-					sin(ia.idle.z_disp.off
-						+ ia.idle.z_disp.freq*time));
-				break;
-			case ITEM_STATE_BOBBING:
-				params.y += ia.bobbing.mag * sin(
-					ia.bobbing.off + ia.bobbing.freq*time);
-				break;
-			case ITEM_STATE_MOVING: {
-				f32 dt = (time - ia.moving.start_time)
-					/ ia.moving.duration;
-				params.x = (ia.moving.ex - ia.moving.sx) * dt
-					+ ia.moving.sx;
-				params.z = (ia.moving.ez - ia.moving.sz) * dt
-					+ ia.moving.sz;
-				params.y = (ia.moving.ey - ia.moving.sy) * dt
-					+ ia.moving.sy
-					+ 4.0f * dt*(1.0f - dt) * JUMP_HEIGHT;
-			} break;
-			case ITEM_STATE_REBOUND: {
-				f32 dt = (time - ia.rebound.start_time)
-					/ ia.rebound.duration;
-				f32 dx = dt < 0.5f ? dt : 1.0f - dt;
-				dx *= BOUNCE_DISTANCE;
-				params.x += dx * ia.rebound.dx;
-				params.z += dx * ia.rebound.dz;
-				params.y += 4.0f * dt*(1.0f - dt)
-					* JUMP_HEIGHT;
-			} break;
-			case ITEM_STATE_COLLECTING: {
-				f32 dt = (time - ia.collecting.start_time)
-					/ ia.collecting.duration;
-				params.y += dt*dt;
-			} break;
-			case ITEM_STATE_FALLING: {
-				f32 dt = (time - ia.falling.start_time)
-					/ ia.falling.duration;
-				params.x = (ia.falling.ex - ia.falling.sx) * dt
-					+ ia.falling.sx;
-				params.z = (ia.falling.ez - ia.falling.sz) * dt
-					+ ia.falling.sz;
-				params.y = (ia.falling.ey - ia.falling.sy) * dt
-					+ ia.falling.sy;
-			} break;
-
-			}
-			if (ia.is_char) {
-				add_item(params);
-			} else {
-				struct cube_params c_params;
-				c_params.r = params.r;
-				c_params.g = params.g;
-				c_params.b = params.b;
-				c_params.x = params.x;
-				c_params.y = params.y;
-				c_params.z = params.z;
-				add_cube(c_params);
-			}
-		}
+		set_world_time(time);
 		draw_world();
-		reset_characters();
-		for (u32 i = 1; i < level->num_colors; ++i) {
-			struct health_animator *ha = &health_animators[i];
-			sprintf(ha->text, "\003: %hhu", ha->amount);
-				// level->player_health[i]);
-			struct color c = level->color_map[i];
-			if (ha->state == HEALTH_ANIM_FLASHING) {
-				if (time > ha->flashing.start_time
-						+ ha->flashing.duration) {
-					ha->state = HEALTH_ANIM_IDLE;
-				} else {
-					f32 dt = (time
-						- ha->flashing.start_time)
-						/ ha->flashing.duration;
-					if ((u32)(dt * (f32)NUM_HEALTH_FLASHES)
-							% 2 == 0) {
-						c = (struct color){
-							.r=1.0f,
-							.g=1.0f,
-							.b=1.0f,
-						};
-					}
-				}
-			}
-			add_string(ha->text, c, 4.0f, 2.0f, -((f32)i));
-		}
 		draw_characters();
 		if (
 				cur_state == STATE_FADE_IN  ||
@@ -597,6 +654,7 @@ enum outcome run_game_ui(SDL_Window *window, struct level *level) {
 			draw_fade();
 		}
 		SDL_GL_SwapWindow(window);
+		report_render_stats(time, waited);
 	}
 
 	return program_outcome;
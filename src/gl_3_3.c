@@ -2,5 +2,6 @@
 
 #define GL_FUNC(return_type, name, ...) _##name *name;
 GL_3_3_FUNCTIONS
+GL_PROGRAM_BINARY_FUNCTIONS
 #undef GL_FUNC
 
@@ -1,496 +1,263 @@
 #include "levels.h"
 
-#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include "opengl.h"
+#include "bytes.h"
+#include "files.h"
 
-static void build_level_0(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =  3.0f;
-	params.camera_pos.y =  5.0f;
-	params.camera_pos.z = -9.0f;
-	params.look_at.x = 3.0f;
-	params.look_at.y = 0.0f;
-	params.look_at.z = 3.0f;
-	set_camera(params);
+static const u8 level_pack_magic[4] = { 'L', 'D', 'L', 'V' };
 
-	level->layers = 2;
-	level->width  = 7;
-	level->height = 1;
-	level->background_color
-		= (struct color){ .r = 0.0f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 0.0f, .g = 1.0f, .b = 0.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.0f, .b=0.0f };
-	level->player_health[1] = 1;
-	level->num_colors = 2;
-	char *level_strs[] = {
-		"@     !",
+static struct mapped_file pack_file;
+static u32 pack_level_count;
+static const u8 *pack_index;
 
-		"#######",
-	};
-	build_level_from_strings(level, level_strs);
+static void put_f32(u8 *p, f32 x) {
+	u32 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	put_u32(p, bits);
 }
 
-static void build_level_1(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =   5.0f;
-	params.camera_pos.y =  10.0f;
-	params.camera_pos.z = -12.0f;
-	params.look_at.x = 5.0f;
-	params.look_at.y = 0.0f;
-	params.look_at.z = 3.0f;
-	set_camera(params);
-
-	level->layers = 2;
-	level->width  = 11;
-	level->height = 3;
-	level->background_color
-		= (struct color){ .r = 0.0f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 0.0f, .g = 1.0f, .b = 0.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.0f, .b=0.0f };
-	level->player_health[1] = 1;
-	level->num_colors = 2;
-	char *level_strs[] = {
-		"           ",
-		" a   @   ! ",
-		"           ",
-
-		"### ### ###",
-		"#######1###",
-		"### ### ###",
-	};
-	build_level_from_strings(level, level_strs);
+static f32 get_f32(const u8 *p) {
+	u32 bits = get_u32(p);
+	f32 x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
 }
 
-static void build_level_2(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =   5.0f;
-	params.camera_pos.y =   9.0f;
-	params.camera_pos.z = -12.0f;
-	params.look_at.x = 5.0f;
-	params.look_at.y = 0.0f;
-	params.look_at.z = 3.0f;
-	set_camera(params);
-
-	level->layers =  2;
-	level->width  = 11;
-	level->height =  4;
-	level->background_color
-		= (struct color){ .r = 0.0f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 0.0f, .g = 1.0f, .b = 0.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.0f, .b=0.0f };
-	level->player_health[1] = 2;
-	level->num_colors = 2;
-	char *level_strs[] = {
-		"    ###    ",
-		"    # #    ",
-		" @   1   ! ",
-		"      #    ",
-
-		"    ###    ",
-		"### ### ###",
-		"###########",
-		"### ### ###",
-	};
-	build_level_from_strings(level, level_strs);
+static void put_color(u8 *p, struct color c) {
+	put_f32(p,     c.r);
+	put_f32(p + 4, c.g);
+	put_f32(p + 8, c.b);
 }
 
-static void build_level_3(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =   5.0f;
-	params.camera_pos.y =  10.0f;
-	params.camera_pos.z = -12.0f;
-	params.look_at.x = 5.0f;
-	params.look_at.y = 0.0f;
-	params.look_at.z = 3.0f;
-	set_camera(params);
-
-	level->layers = 2;
-	level->width  = 11;
-	level->height = 3;
-	level->background_color
-		= (struct color){ .r = 0.0f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 0.0f, .g = 1.0f, .b = 0.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.6f, .b=0.1f };
-	level->color_map[2] = (struct color){ .r=0.1f, .g=0.6f, .b=1.0f };
-	level->player_health[1] = 1;
-	level->player_health[2] = 1;
-	level->num_colors = 3;
-	char *level_strs[] = {
-		"           ",
-		" @       ! ",
-		"           ",
-
-		"###1# #2###",
-		"### #2# ###",
-		"###2# #1###",
+static struct color get_color(const u8 *p) {
+	return (struct color){
+		.r = get_f32(p), .g = get_f32(p + 4), .b = get_f32(p + 8),
 	};
-	build_level_from_strings(level, level_strs);
 }
 
-static void build_level_4(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =   6.0f;
-	params.camera_pos.y =  12.0f;
-	params.camera_pos.z = -15.0f;
-	params.look_at.x = 6.0f;
-	params.look_at.y = 2.0f;
-	params.look_at.z = 3.0f;
-	set_camera(params);
-
-	level->layers = 4;
-	level->width  = 13;
-	level->height = 3;
-	level->background_color
-		= (struct color){ .r = 0.0f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 0.0f, .g = 1.0f, .b = 0.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.6f, .b=0.1f };
-	level->color_map[2] = (struct color){ .r=0.1f, .g=0.6f, .b=1.0f };
-	level->player_health[1] = 1;
-	level->player_health[2] = 1;
-	level->num_colors = 3;
-	char *level_strs[] = {
-		"             ",
-		" 1@2      !  ",
-		"             ",
-
-		"#####   #####",
-		"###### ######",
-		"#####   #####",
-
-		"             ",
-		"     # #     ",
-		"             ",
-
-		"             ",
-		"     ###     ",
-		"             ",
-	};
-	build_level_from_strings(level, level_strs);
+static u64 level_size(u32 num_colors, u32 num_blocks) {
+	return LEVEL_HEADER_SIZE + (u64)num_colors * LEVEL_COLOR_SIZE
+		+ (u64)num_blocks * LEVEL_BLOCK_SIZE;
 }
 
-static void build_level_5(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =  5.0f;
-	params.camera_pos.y =  12.0f;
-	params.camera_pos.z = -12.0f;
-	params.look_at.x = 5.0f;
-	params.look_at.y = 0.0f;
-	params.look_at.z = 5.0f;
-	set_camera(params);
-
-	level->layers =  2;
-	level->width  = 11;
-	level->height =  7;
-	level->background_color
-		= (struct color){ .r = 0.0f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 0.0f, .g = 1.0f, .b = 0.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.0f, .b=0.0f };
-	level->player_health[1] = 3;
-	level->num_colors = 2;
-	char *level_strs[] = {
-		" a       a ",
-		"a a     a a",
-		" a  1 1  a ",
-		"     @     ",
-		" a  1 1    ",
-		"a a      ! ",
-		" a         ",
+enum level_pack_error open_levels(const char *path) {
+	close_levels();
+	if (map_file(path, &pack_file)) {
+		return LEVEL_PACK_NOT_FOUND;
+	}
+	enum level_pack_error error = LEVEL_PACK_TRUNCATED;
+	const u8 *data = pack_file.data;
+	u64 size = pack_file.size;
+	if (size < LEVEL_PACK_HEADER_SIZE) {
+		goto error;
+	}
+	error = LEVEL_PACK_BAD_MAGIC;
+	if (memcmp(data, level_pack_magic, sizeof(level_pack_magic)) != 0) {
+		goto error;
+	}
+	error = LEVEL_PACK_BAD_VERSION;
+	if (get_u16(data + 4) != LEVEL_PACK_VERSION) {
+		goto error;
+	}
+	u32 count = get_u16(data + 6);
+	u64 index_size = (u64)count * LEVEL_PACK_ENTRY_SIZE;
+	error = LEVEL_PACK_TRUNCATED;
+	if (size - LEVEL_PACK_HEADER_SIZE < index_size) {
+		goto error;
+	}
+	const u8 *index = data + LEVEL_PACK_HEADER_SIZE;
+	error = LEVEL_PACK_BAD_CHECKSUM;
+	if (get_u32(data + 8) != fnv32(FNV_OFFSET_32, index, index_size)) {
+		goto error;
+	}
+	// Every level has to lie inside the file, so build_level needn't check.
+	error = LEVEL_PACK_TRUNCATED;
+	for (u32 i = 0; i < count; ++i) {
+		const u8 *entry = index + i * LEVEL_PACK_ENTRY_SIZE;
+		u32 offset = get_u32(entry);
+		if (offset > size || size - offset < get_u32(entry + 4)) {
+			goto error;
+		}
+	}
+	pack_level_count = count;
+	pack_index = index;
+	return LEVEL_PACK_OK;
 
-		"###     ###",
-		"###     ###",
-		"### ### ###",
-		"    ###   ",
-		"### ### 111",
-		"###     111",
-		"###     111",
-	};
-	build_level_from_strings(level, level_strs);
+error:
+	unmap_file(&pack_file);
+	return error;
 }
 
-static void build_level_6(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =  4.0f;
-	params.camera_pos.y =  15.0f;
-	params.camera_pos.z = -15.0f;
-	params.look_at.x = 4.0f;
-	params.look_at.y = 2.0f;
-	params.look_at.z = 5.0f;
-	set_camera(params);
-
-	level->layers = 6;
-	level->width  = 9;
-	level->height = 9;
-	level->background_color
-		= (struct color){ .r = 0.1f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.9f, .g = 0.9f, .b = 0.9f };
-	level->goal_color
-		= (struct color){ .r = 1.0f, .g = 1.0f, .b = 1.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.0f, .b=1.0f };
-	level->color_map[2] = (struct color){ .r=0.0f, .g=1.0f, .b=1.0f };
-	level->player_health[1] = 2;
-	level->player_health[2] = 2;
-	level->num_colors = 3;
-	char *level_strs[] = {
-		"         ",
-		" @       ",
-		"         ",
-		"         ",
-		"         ",
-		"         ",
-		"         ",
-		"         ",
-		"         ",
-
-		"###      ",
-		"### a    ",
-		"###      ",
-		"         ",
-		" b       ",
-		"         ",
-		"         ",
-		"         ",
-		"         ",
-
-		"   ###   ",
-		"   ### a ",
-		"   ###   ",
-		"###      ",
-		"### a    ",
-		"###      ",
-		"         ",
-		" b       ",
-		"         ",
-
-		"      ###",
-		"      ###",
-		"      ###",
-		"   ###   ",
-		"   ### b ",
-		"   ###   ",
-		"###      ",
-		"### a    ",
-		"###      ",
-
-		"         ",
-		"         ",
-		"         ",
-		"      ###",
-		"      ###",
-		"      ###",
-		"   ###   ",
-		"   ### ! ",
-		"   ###   ",
-
-		"         ",
-		"         ",
-		"         ",
-		"         ",
-		"         ",
-		"         ",
-		"      ###",
-		"      ###",
-		"      ###",
-	};
-	build_level_from_strings(level, level_strs);
+void close_levels(void) {
+	unmap_file(&pack_file);
+	pack_level_count = 0;
+	pack_index = NULL;
 }
 
-static void build_level_7(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =  5.0f;
-	params.camera_pos.y =  14.0f;
-	params.camera_pos.z = -10.0f;
-	params.look_at.x = 5.0f;
-	params.look_at.y = 0.0f;
-	params.look_at.z = 5.0f;
-	set_camera(params);
-
-	level->layers =  3;
-	level->width  = 11;
-	level->height =  5;
-	level->background_color
-		= (struct color){ .r = 0.0f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 1.0f, .g = 1.0f, .b = 1.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.0f, .b=0.0f };
-	level->color_map[2] = (struct color){ .r=0.0f, .g=1.0f, .b=0.0f };
-	level->color_map[3] = (struct color){ .r=0.0f, .g=0.0f, .b=1.0f };
-	level->player_health[1] = 1;
-	level->player_health[2] = 2;
-	level->player_health[3] = 1;
-	level->num_colors = 4;
-	char *level_strs[] = {
-		"            ",
-		"  1         ",
-		" @2       ! ",
-		"  3         ",
-		"            ",
-
-		" ###        ",
-		"####     ###",
-		"#### # # ###",
-		"####     ###",
-		" ###        ",
-
-		"            ",
-		"            ",
-		"   #######  ",
-		"            ",
-		"            ",
-	};
-	build_level_from_strings(level, level_strs);
+u32 num_pack_levels(void) {
+	return pack_level_count;
 }
 
-static void build_level_8(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =  6.0f;
-	params.camera_pos.y =  16.0f;
-	params.camera_pos.z = -10.0f;
-	params.look_at.x = 6.0f;
-	params.look_at.y = 0.0f;
-	params.look_at.z = 6.0f;
-	set_camera(params);
-
-	level->layers =  3;
-	level->width  = 13;
-	level->height =  9;
-	level->background_color
-		= (struct color){ .r = 0.0f, .g = 0.0f, .b = 0.1f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 1.0f, .g = 1.0f, .b = 1.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.75f, .b=0.0f };
-	level->color_map[2] = (struct color){ .r=0.0f, .g=0.75f, .b=1.0f };
-	level->player_health[1] = 0;
-	level->player_health[2] = 4;
-	level->num_colors = 3;
-	char *level_strs[] = {
-		"             ",
-		"   @         ",
-		"             ",
-		"  2 2        ",
-		"   1       ! ",
-		"  2 2        ",
-		"             ",
-		"             ",
-		"             ",
-
-		"  ###        ",
-		"  ###        ",
-		"  ###        ",
-		"######    ###",
-		"######    ###",
-		"######    ###",
-		"  ###        ",
-		"  ###        ",
-		"  ###        ",
-
-		"             ",
-		"             ",
-		"             ",
-		"     ######  ",
-		"     ######  ",
-		"     ######  ",
-		"             ",
-		"             ",
-		"             ",
-	};
-	build_level_from_strings(level, level_strs);
+// Everything that plays a level, from the game to the solver, looks the
+// player up and expects to find exactly one.
+static u32 count_players(struct level *level) {
+	u32 num_players = 0;
+	for (u32 i = 1; i < level->num_blocks; ++i) {
+		num_players += level->blocks[i].type == BLOCK_TYPE_PLAYER;
+	}
+	return num_players;
 }
 
-static void build_level_9(struct level *level) {
-	struct camera_params params;
-	params.camera_pos.x =  4.5f;
-	params.camera_pos.y =  10.0f;
-	params.camera_pos.z = -10.0f;
-	params.look_at.x = 4.5f;
-	params.look_at.y = 0.0f;
-	params.look_at.z = 5.0f;
-	set_camera(params);
-
-	level->layers =  5;
-	level->width  = 10;
-	level->height =  3;
-	level->background_color
-		= (struct color){ .r = 0.1f, .g = 0.0f, .b = 0.0f };
-	level->player_color
-		= (struct color){ .r = 0.75f, .g = 0.75f, .b = 0.75f };
-	level->goal_color
-		= (struct color){ .r = 1.0f, .g = 1.0f, .b = 1.0f };
-	level->color_map[0] = (struct color){ .r=0.5f, .g=0.5f, .b=0.5f };
-	level->color_map[1] = (struct color){ .r=1.0f, .g=0.0, .b=0.0f };
-	level->color_map[2] = (struct color){ .r=0.0f, .g=1.0, .b=0.0f };
-	level->player_health[1] = 0;
-	level->player_health[2] = 3;
-	level->num_colors = 3;
-	char *level_strs[] = {
-		"          ",
-		"  2       ",
-		"          ",
-
-		"          ",
-		"  2       ",
-		"          ",
+enum level_pack_error build_level(struct level *level, u32 n) {
+	if (n >= pack_level_count) {
+		return LEVEL_PACK_NO_LEVEL;
+	}
+	const u8 *entry = pack_index + n * LEVEL_PACK_ENTRY_SIZE;
+	const u8 *data = pack_file.data + get_u32(entry);
+	u32 size = get_u32(entry + 4);
+	if (get_u32(entry + 8) != fnv32(FNV_OFFSET_32, data, size)) {
+		return LEVEL_PACK_BAD_CHECKSUM;
+	}
+	if (size < LEVEL_HEADER_SIZE) {
+		return LEVEL_PACK_BAD_LEVEL;
+	}
+	u32 num_colors = data[3];
+	u32 num_blocks = get_u16(data + 4);
+	if (data[0] > MAX_LEVEL_WIDTH || data[1] > MAX_LEVEL_HEIGHT
+			|| data[2] > MAX_LEVEL_LAYERS || num_colors > MAX_COLORS
+			|| num_blocks >= MAX_BLOCKS
+			|| size != level_size(num_colors, num_blocks)) {
+		return LEVEL_PACK_BAD_LEVEL;
+	}
 
-		"          ",
-		" @1     ! ",
-		"          ",
+	reset_level(level);
+	level->width  = data[0];
+	level->height = data[1];
+	level->layers = data[2];
+	level->camera.camera_pos.x = get_f32(data + 8);
+	level->camera.camera_pos.y = get_f32(data + 12);
+	level->camera.camera_pos.z = get_f32(data + 16);
+	level->camera.look_at.x    = get_f32(data + 20);
+	level->camera.look_at.y    = get_f32(data + 24);
+	level->camera.look_at.z    = get_f32(data + 28);
+	level->background_color = get_color(data + 32);
+	level->player_color     = get_color(data + 44);
+	level->goal_color       = get_color(data + 56);
+	level->num_colors = num_colors;
+	const u8 *p = data + LEVEL_HEADER_SIZE;
+	for (u32 i = 0; i < num_colors; ++i, p += LEVEL_COLOR_SIZE) {
+		level->color_map[i]     = get_color(p);
+		level->player_health[i] = p[12];
+	}
+	for (u32 i = 0; i < num_blocks; ++i, p += LEVEL_BLOCK_SIZE) {
+		if (p[0] == BLOCK_TYPE_EMPTY || p[0] > BLOCK_TYPE_GOAL
+				|| p[4] >= MAX_COLORS) {
+			return LEVEL_PACK_BAD_LEVEL;
+		}
+		struct block block = {
+			.type = p[0],
+			.pos = { .x = (i8)p[1], .y = (i8)p[2], .z = (i8)p[3] },
+		};
+		// Hearts share the colour's place in the union with cubes.
+		block.cube.color = p[4];
+		add_block(level, block);
+	}
+	if (count_players(level) != 1) {
+		return LEVEL_PACK_BAD_LEVEL;
+	}
+	return LEVEL_PACK_OK;
+}
 
-		"#####  ###",
-		"#####  ###",
-		"#####  ###",
+static void write_level(u8 *p, struct level *level) {
+	p[0] = level->width;
+	p[1] = level->height;
+	p[2] = level->layers;
+	p[3] = level->num_colors;
+	put_u16(p + 4, level->num_blocks - 1);
+	put_u16(p + 6, 0);
+	put_f32(p + 8,  level->camera.camera_pos.x);
+	put_f32(p + 12, level->camera.camera_pos.y);
+	put_f32(p + 16, level->camera.camera_pos.z);
+	put_f32(p + 20, level->camera.look_at.x);
+	put_f32(p + 24, level->camera.look_at.y);
+	put_f32(p + 28, level->camera.look_at.z);
+	put_color(p + 32, level->background_color);
+	put_color(p + 44, level->player_color);
+	put_color(p + 56, level->goal_color);
+	p += LEVEL_HEADER_SIZE;
+	for (u32 i = 0; i < level->num_colors; ++i, p += LEVEL_COLOR_SIZE) {
+		put_color(p, level->color_map[i]);
+		p[12] = level->player_health[i];
+	}
+	// In block id order, so the ids come out the same when loaded.
+	for (u32 id = 1; id < level->num_block_ids; ++id) {
+		struct block *b = &level->blocks[level->block_slots[id]];
+		p[0] = b->type;
+		p[1] = (u8)b->pos.x;
+		p[2] = (u8)b->pos.y;
+		p[3] = (u8)b->pos.z;
+		p[4] = b->type == BLOCK_TYPE_CUBE || b->type == BLOCK_TYPE_HEART
+			? b->cube.color : 0;
+		p += LEVEL_BLOCK_SIZE;
+	}
+}
 
-		"          ",
-		"    ####  ",
-		"          ",
-	};
-	build_level_from_strings(level, level_strs);
+// Levels must be as built, with block ids 1 to num_blocks - 1 all in use,
+// and have exactly one player, as build_level insists.
+i32 write_level_pack(FILE *out, struct level *levels, u32 num_levels) {
+	if (num_levels > 0xffff) {
+		return 1;
+	}
+	u64 index_size = (u64)num_levels * LEVEL_PACK_ENTRY_SIZE;
+	u64 size = LEVEL_PACK_HEADER_SIZE + index_size;
+	for (u32 i = 0; i < num_levels; ++i) {
+		if (levels[i].num_block_ids != levels[i].num_blocks
+				|| count_players(&levels[i]) != 1) {
+			return 1;
+		}
+		size += level_size(levels[i].num_colors, levels[i].num_blocks - 1);
+	}
+	if (size > 0xffffffffu) {
+		return 1;
+	}
+	u8 *data = calloc(size, 1);
+	if (data == NULL) {
+		return 1;
+	}
+	u8 *index = data + LEVEL_PACK_HEADER_SIZE;
+	u32 offset = LEVEL_PACK_HEADER_SIZE + index_size;
+	for (u32 i = 0; i < num_levels; ++i) {
+		struct level *level = &levels[i];
+		u32 level_bytes = level_size(level->num_colors,
+			level->num_blocks - 1);
+		write_level(data + offset, level);
+		u8 *entry = index + i * LEVEL_PACK_ENTRY_SIZE;
+		put_u32(entry,     offset);
+		put_u32(entry + 4, level_bytes);
+		put_u32(entry + 8, fnv32(FNV_OFFSET_32, data + offset, level_bytes));
+		offset += level_bytes;
+	}
+	memcpy(data, level_pack_magic, sizeof(level_pack_magic));
+	put_u16(data + 4, LEVEL_PACK_VERSION);
+	put_u16(data + 6, num_levels);
+	put_u32(data + 8, fnv32(FNV_OFFSET_32, index, index_size));
+	i32 result = fwrite(data, size, 1, out) != 1;
+	free(data);
+	return result;
 }
 
-i32 build_level(struct level *level, u32 n) {
-	reset_level(level);
-	switch (n) {
-	case 0: build_level_0(level); return 0;
-	case 1: build_level_1(level); return 0;
-	case 2: build_level_2(level); return 0;
-	case 3: build_level_5(level); return 0;
-	case 4: build_level_3(level); return 0;
-	case 5: build_level_4(level); return 0;
-	case 6: build_level_6(level); return 0;
-	case 7: build_level_7(level); return 0;
-	case 8: build_level_8(level); return 0;
-	case 9: build_level_9(level); return 0;
+const char *level_pack_error_string(enum level_pack_error error) {
+	switch (error) {
+	case LEVEL_PACK_OK:           return "ok";
+	case LEVEL_PACK_NOT_FOUND:    return "not found";
+	case LEVEL_PACK_TRUNCATED:    return "truncated level pack";
+	case LEVEL_PACK_BAD_MAGIC:    return "not a level pack";
+	case LEVEL_PACK_BAD_VERSION:  return "unsupported version";
+	case LEVEL_PACK_BAD_CHECKSUM: return "checksum mismatch";
+	case LEVEL_PACK_BAD_LEVEL:    return "malformed level";
+	case LEVEL_PACK_NO_LEVEL:     return "no such level";
 	}
-	return 1;
+	return "unknown error";
 }
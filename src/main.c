@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <SDL.h>
@@ -9,16 +10,67 @@
 #include "game_ui.h"
 #include "end_ui.h"
 #include "audio.h"
+#include "assets.h"
+#include "replay.h"
+
+static u64 startup_start, phase_start;
+
+static f64 ticks_to_ms(u64 ticks) {
+	return ticks * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Logs how long the startup phase that just finished took.
+static void end_phase(const char *name) {
+	u64 now = SDL_GetPerformanceCounter();
+	SDL_Log("%s: %.1f ms", name, ticks_to_ms(now - phase_start));
+	phase_start = now;
+}
 
 i32 main(i32 argc, char *argv[]) {
 	i32 exit_success = EXIT_FAILURE;
+	startup_start = phase_start = SDL_GetPerformanceCounter();
 
 	srand(time(NULL));
 
+	// Every attempt at a level is appended to the replay file, if given.
+	FILE *replay_file = NULL;
+	if (argc > 1) {
+		replay_file = fopen(argv[1], "ab");
+		if (replay_file == NULL) {
+			SDL_Log("Unable to open replay file '%s'", argv[1]);
+			goto error_open_replay_file;
+		}
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS) != 0) {
 		SDL_Log("Unable to initialize SDL : %s", SDL_GetError());
 		goto error_failed_init;
 	};
+	end_phase("SDL init");
+	if (open_assets()) {
+		goto error_open_assets;
+	}
+	char *level_path = asset_path("levels.pak");
+	if (level_path == NULL) {
+		goto error_open_levels;
+	}
+	enum level_pack_error level_error = open_levels(level_path);
+	if (level_error != LEVEL_PACK_OK) {
+		SDL_Log("Unable to open '%s': %s", level_path,
+			level_pack_error_string(level_error));
+		free(level_path);
+		goto error_open_levels;
+	}
+	free(level_path);
+	// Asset reads and decoding run on worker threads from here, alongside
+	// the window and context setup. The main thread only does GL uploads.
+	start_loading_textures();
+
+	// Reports draw and upload counts about once a second.
+	if (getenv("LD44_RENDER_STATS")) {
+		SDL_LogSetPriority(SDL_LOG_CATEGORY_RENDER,
+			SDL_LOG_PRIORITY_DEBUG);
+	}
 
 	// Don't know how to error check this...
 	Mix_Init(0);
@@ -27,6 +79,8 @@ i32 main(i32 argc, char *argv[]) {
 		SDL_Log("Unable to open audio: %s", Mix_GetError());
 		goto error_failed_audio;
 	}
+	end_phase("Audio open");
+	start_loading_audio();
 
 	if (SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
 			SDL_GL_CONTEXT_PROFILE_CORE) != 0) {
@@ -64,6 +118,7 @@ i32 main(i32 argc, char *argv[]) {
 	}
 
 	SDL_GL_SetSwapInterval(1);
+	end_phase("Window and GL context");
 
 #define GL_FUNC(_return_value, name, ...) \
 	name = SDL_GL_GetProcAddress(#name); \
@@ -74,22 +129,53 @@ i32 main(i32 argc, char *argv[]) {
 	}
 	GL_3_3_FUNCTIONS
 #undef GL_FUNC
+#define GL_FUNC(_return_value, name, ...) \
+	name = SDL_GL_GetProcAddress(#name);
+	GL_PROGRAM_BINARY_FUNCTIONS
+#undef GL_FUNC
+	end_phase("GL function load");
 
 	if (init_opengl()) {
 		goto error_failed_init_opengl;
 	}
+	end_phase("GL init");
 	if (init_audio()) {
 		goto error_failed_init_audio;
 	}
+	end_phase("Audio init");
+	// Everything has been read out of the archive by now.
+	close_assets();
+	if (init_game_ui()) {
+		SDL_Log("Unable to initialize game UI");
+		goto error_failed_init_game_ui;
+	}
+	end_phase("Game UI init");
+	prepare_level(0);
+	SDL_Log("Startup: %.1f ms", ticks_to_ms(phase_start - startup_start));
 
 	// success
-	struct level level;
 	u32 cur_level = 0;
 	while (1) {
-		if (build_level(&level, cur_level)) {
+		if (cur_level == num_pack_levels()) {
 			goto exit_with_outro;
 		}
-		enum outcome outcome = run_game_ui(window, &level);
+		// Usually prepared while the last attempt faded out.
+		u32 seed;
+		level_error = wait_for_level(cur_level, &seed);
+		if (level_error != LEVEL_PACK_OK) {
+			SDL_Log("Unable to load level %u: %s", cur_level,
+				level_pack_error_string(level_error));
+			goto error_build_level;
+		}
+		struct replay replay;
+		init_replay(&replay, cur_level, seed);
+		enum outcome outcome = run_game_ui(window,
+			replay_file ? &replay : NULL);
+		if (replay_file && (write_replay(replay_file, &replay)
+				|| fflush(replay_file))) {
+			SDL_Log("Failed to write replay");
+		}
+		free_replay(&replay);
 		switch (outcome) {
 		case OUTCOME_DEATH:
 			// Try again...
@@ -108,6 +194,9 @@ exit_with_outro:
 successful_exit:
 	exit_success = EXIT_SUCCESS;
 
+error_build_level:
+	quit_game_ui();
+error_failed_init_game_ui:
 	quit_audio();
 error_failed_init_audio:
 	quit_opengl();
@@ -120,9 +209,20 @@ error_failed_window:
 error_set_gl_minor_version:
 error_set_gl_major_version:
 error_gl_context_profile:
+	// These do nothing once init_audio and init_opengl have waited.
+	cancel_loading_audio();
 error_failed_audio:
+	cancel_loading_textures();
+	close_levels();
+error_open_levels:
+	close_assets();
+error_open_assets:
 	Mix_Quit();
 	SDL_Quit();
 error_failed_init:
+	if (replay_file) {
+		fclose(replay_file);
+	}
+error_open_replay_file:
 	return exit_success;
 }
@@ -8,6 +8,9 @@
 #include <math.h>
 
 #include "gl_3_3.h"
+#include "program_cache.h"
+#include "assets.h"
+#include "texture.h"
 
 #define FONT_TEX_LOC 0
 
@@ -58,6 +61,172 @@ static GLuint link_program(GLuint program) {
 	return program;
 }
 
+static u32 programs_built, programs_from_cache;
+static u64 program_build_ticks;
+
+// Loads the program from the cache if it has a binary for these sources that
+// the driver still takes, and compiles them otherwise. The shaders are left
+// 0 for a cached program, which glDeleteShader ignores.
+static GLuint create_program(const GLchar *vert_src, const GLchar *frag_src,
+		GLuint *vert_shader, GLuint *frag_shader) {
+	u64 start = SDL_GetPerformanceCounter();
+	*vert_shader = 0;
+	*frag_shader = 0;
+	GLuint program = load_cached_program(vert_src, frag_src);
+	if (program) {
+		++programs_from_cache;
+		goto done;
+	}
+	*vert_shader = compile_shader(GL_VERTEX_SHADER,   vert_src);
+	*frag_shader = compile_shader(GL_FRAGMENT_SHADER, frag_src);
+	program = glCreateProgram();
+	glAttachShader(program, *vert_shader);
+	glAttachShader(program, *frag_shader);
+	hint_program_retrievable(program);
+	program = link_program(program);
+	if (program) {
+		save_cached_program(program, vert_src, frag_src);
+	}
+done:
+	++programs_built;
+	program_build_ticks += SDL_GetPerformanceCounter() - start;
+	return program;
+}
+
+// =============================================================================
+// instance streams
+// =============================================================================
+
+// Each stream's buffer holds this many copies of its instances. A draw reads
+// one region while the next changes are written to another, so writes never
+// wait on the GPU unless it's this many frames behind.
+#define STREAM_REGIONS 3
+#define STREAM_WAIT_TIMEOUT_NS 1000000000ull
+
+// Instances in [start, end) have changed since a region was last written.
+struct dirty_range {
+	u32 start, end;
+};
+
+struct instance_stream {
+	GLuint buffer;
+	u32 instance_size, max_instances;
+	// The region draws read from.
+	u32 region;
+	// Set after the last draw that read each region.
+	GLsync fences[STREAM_REGIONS];
+	struct dirty_range dirty[STREAM_REGIONS];
+};
+
+static struct render_stats render_stats;
+
+static void init_stream(struct instance_stream *stream,
+		u32 instance_size, u32 max_instances) {
+	memset(stream, 0, sizeof(*stream));
+	stream->instance_size = instance_size;
+	stream->max_instances = max_instances;
+	glGenBuffers(1, &stream->buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+	glBufferData(GL_ARRAY_BUFFER,
+		STREAM_REGIONS * max_instances * instance_size,
+		NULL, GL_STREAM_DRAW);
+}
+
+static void free_stream(struct instance_stream *stream) {
+	for (u32 r = 0; r < STREAM_REGIONS; ++r) {
+		if (stream->fences[r]) {
+			glDeleteSync(stream->fences[r]);
+		}
+	}
+	glDeleteBuffers(1, &stream->buffer);
+}
+
+static void reset_stream(struct instance_stream *stream) {
+	for (u32 r = 0; r < STREAM_REGIONS; ++r) {
+		stream->dirty[r].start = stream->dirty[r].end = 0;
+	}
+}
+
+static void mark_stream_dirty(struct instance_stream *stream,
+		u32 start, u32 end) {
+	for (u32 r = 0; r < STREAM_REGIONS; ++r) {
+		struct dirty_range *range = &stream->dirty[r];
+		if (range->start >= range->end) {
+			range->start = start;
+			range->end   = end;
+		} else {
+			range->start = MIN(range->start, start);
+			range->end   = MAX(range->end, end);
+		}
+	}
+}
+
+static GLintptr stream_base(struct instance_stream *stream) {
+	return (GLintptr)stream->region
+		* stream->max_instances * stream->instance_size;
+}
+
+// If the region being drawn from is out of date, moves on to the next one and
+// writes everything that changed since that was last written. Returns
+// non-zero when the region moved, so attribute pointers need setting again.
+static i32 upload_stream(struct instance_stream *stream,
+		const void *instances) {
+	if (stream->dirty[stream->region].start
+			>= stream->dirty[stream->region].end) {
+		return 0;
+	}
+	u32 r = (stream->region + 1) % STREAM_REGIONS;
+	stream->region = r;
+	if (stream->fences[r]) {
+		if (glClientWaitSync(stream->fences[r], 0, 0)
+				== GL_TIMEOUT_EXPIRED) {
+			++render_stats.sync_waits;
+			glClientWaitSync(stream->fences[r],
+				GL_SYNC_FLUSH_COMMANDS_BIT,
+				STREAM_WAIT_TIMEOUT_NS);
+		}
+		glDeleteSync(stream->fences[r]);
+		stream->fences[r] = NULL;
+	}
+
+	struct dirty_range *range = &stream->dirty[r];
+	u32 size = (range->end - range->start) * stream->instance_size;
+	GLintptr offset = stream_base(stream)
+		+ range->start * stream->instance_size;
+	const u8 *src = (const u8 *)instances
+		+ range->start * stream->instance_size;
+	glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+	// Nothing in the region is in use now, so the driver needn't check.
+	void *dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+		| GL_MAP_UNSYNCHRONIZED_BIT);
+	if (dst) {
+		memcpy(dst, src, size);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	} else {
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, src);
+	}
+	range->start = range->end = 0;
+	++render_stats.uploads;
+	render_stats.bytes_uploaded += size;
+	return 1;
+}
+
+// Call after each draw that reads the stream.
+static void fence_stream(struct instance_stream *stream) {
+	GLsync *fence = &stream->fences[stream->region];
+	if (*fence) {
+		glDeleteSync(*fence);
+	}
+	*fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+struct render_stats take_render_stats(void) {
+	struct render_stats stats = render_stats;
+	memset(&render_stats, 0, sizeof(render_stats));
+	return stats;
+}
+
 static void print_matrix(mat4 m) {
 	for (u32 j = 0; j < 4; ++j) {
 		SDL_Log("%f %f %f %f",
@@ -68,6 +237,166 @@ static void print_matrix(mat4 m) {
 	}
 }
 
+// =============================================================================
+// motion
+// =============================================================================
+
+// Shared by the cube and item vertex shaders, which place each instance with
+// animate() and drop it when motion_hidden() says so. The constants match
+// enum motion_type, and animate() takes the attributes as packed into struct
+// packed_motion.
+#define SHADER_SRC_WITH_MOTION(...) \
+	"#version 330 core\n" MOTION_SHADER_LIB #__VA_ARGS__
+#define SHADER_LIB(...) #__VA_ARGS__
+#define MOTION_SHADER_LIB SHADER_LIB( \
+	uniform float time; \
+	uniform float jump_height; \
+	uniform float bounce_distance; \
+	\
+	const float FIXED_ONE = 256.0f; \
+	const float TURN      = 6.28318531f; \
+	\
+	const uint MOTION_IDLE    = 0u; \
+	const uint MOTION_MOVE    = 1u; \
+	const uint MOTION_FALL    = 2u; \
+	const uint MOTION_REBOUND = 3u; \
+	const uint MOTION_COLLECT = 4u; \
+	\
+	bool motion_hidden(uint motion, vec2 timing) { \
+		return motion == MOTION_COLLECT && time > timing.x + timing.y; \
+	} \
+	\
+	vec3 animate(vec3 fixed_pos, uint motion, vec2 timing, vec3 fixed_from, \
+			vec3 idle_mag, vec3 idle_off, vec3 idle_freq) { \
+		vec3 pos  = fixed_pos / FIXED_ONE; \
+		vec3 from = fixed_from / FIXED_ONE; \
+		float dt = (time - timing.x) / timing.y; \
+		if (motion != MOTION_IDLE && dt >= 0.0f && dt <= 1.0f) { \
+			float jump = 4.0f * dt * (1.0f - dt) * jump_height; \
+			if (motion == MOTION_MOVE) { \
+				return mix(from, pos, dt) + vec3(0.0f, jump, 0.0f); \
+			} else if (motion == MOTION_FALL) { \
+				return mix(from, pos, dt); \
+			} else if (motion == MOTION_REBOUND) { \
+				float d = (dt < 0.5f ? dt : 1.0f - dt) * bounce_distance; \
+				return pos + vec3(d * from.x, jump, d * from.z); \
+			} else if (motion == MOTION_COLLECT) { \
+				return pos + vec3(0.0f, dt * dt, 0.0f); \
+			} \
+		} \
+		return pos + idle_mag * sin(idle_off * TURN + idle_freq * time); \
+	} \
+)
+
+static void init_motion_uniforms(GLuint program) {
+	glUseProgram(program);
+	glUniform1f(glGetUniformLocation(program, "jump_height"), JUMP_HEIGHT);
+	glUniform1f(glGetUniformLocation(program, "bounce_distance"),
+		BOUNCE_DISTANCE);
+}
+
+// Instance positions are 8.8 fixed point, which covers any level with room
+// to spare.
+#define FIXED_ONE 256.0f
+#define TURN      6.28318531f
+
+static i16 pack_fixed(f32 x) {
+	assert(x > -128.0f && x < 128.0f);
+	return (i16)lrintf(x * FIXED_ONE);
+}
+
+static u8 pack_unorm8(f32 x) {
+	return (u8)lrintf(MIN(MAX(x, 0.0f), 1.0f) * 255.0f);
+}
+
+// Rounds to the nearest half float. Anything too small for a normal half
+// becomes zero and anything too big infinity.
+static u16 pack_half(f32 x) {
+	u32 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	u16 sign = (bits >> 16) & 0x8000;
+	i32 exponent = (i32)((bits >> 23) & 0xff) - 127 + 15;
+	u32 mantissa = bits & 0x7fffff;
+	if (exponent <= 0) {
+		return sign;
+	}
+	if (exponent >= 31) {
+		return sign | 0x7c00;
+	}
+	// Rounding up may carry into the exponent, which is still right.
+	u32 half = ((u32)exponent << 10) | (mantissa >> 13);
+	half += (mantissa >> 12) & 1;
+	return sign | MIN(half, 0x7c00);
+}
+
+// struct idle_params and struct motion_params as uploaded. Positions are
+// fixed point, the idle phase is in turns, and the idle magnitude and
+// frequency and the duration are half floats.
+struct packed_motion {
+	f32 start_time;
+	u16 duration;
+	i16 from[3];
+	u16 idle_mag[3], idle_freq[3];
+	u8 idle_off[3];
+	u8 type;
+};
+
+static void pack_idle(struct packed_motion *packed, struct idle_params idle) {
+	f32 mag[3]  = { idle.mag.x,  idle.mag.y,  idle.mag.z };
+	f32 off[3]  = { idle.off.x,  idle.off.y,  idle.off.z };
+	f32 freq[3] = { idle.freq.x, idle.freq.y, idle.freq.z };
+	for (u32 i = 0; i < 3; ++i) {
+		f32 turns = off[i] / TURN;
+		packed->idle_mag[i]  = pack_half(mag[i]);
+		packed->idle_off[i]  = pack_unorm8(turns - floorf(turns));
+		packed->idle_freq[i] = pack_half(freq[i]);
+	}
+}
+
+static void pack_motion(struct packed_motion *packed,
+		struct motion_params motion) {
+	packed->type       = motion.type;
+	packed->start_time = motion.start_time;
+	packed->duration   = pack_half(motion.duration);
+	packed->from[0]    = pack_fixed(motion.from.x);
+	packed->from[1]    = pack_fixed(motion.from.y);
+	packed->from[2]    = pack_fixed(motion.from.z);
+}
+
+// Instance attributes from index first on, for a struct packed_motion at
+// motion_offset from the start of the buffer: idle mag, off and freq, then
+// the motion's type, start time, duration and from.
+static void init_motion_attribs(GLuint first, GLsizei stride,
+		size_t motion_offset) {
+	struct {
+		GLint size;
+		GLenum type;
+		GLboolean normalized;
+		size_t offset;
+	} attribs[] = {
+		{ 3, GL_HALF_FLOAT,    GL_FALSE, offsetof(struct packed_motion, idle_mag) },
+		{ 3, GL_UNSIGNED_BYTE, GL_TRUE,  offsetof(struct packed_motion, idle_off) },
+		{ 3, GL_HALF_FLOAT,    GL_FALSE, offsetof(struct packed_motion, idle_freq) },
+		{ 1, GL_UNSIGNED_BYTE, GL_FALSE, offsetof(struct packed_motion, type) },
+		{ 1, GL_FLOAT,         GL_FALSE, offsetof(struct packed_motion, start_time) },
+		{ 1, GL_HALF_FLOAT,    GL_FALSE, offsetof(struct packed_motion, duration) },
+		{ 3, GL_SHORT,         GL_FALSE, offsetof(struct packed_motion, from) },
+	};
+	for (GLuint i = 0; i < ARRAY_LENGTH(attribs); ++i) {
+		GLvoid *offset = (GLvoid*)(motion_offset + attribs[i].offset);
+		if (i == 3) {
+			glVertexAttribIPointer(first + i, attribs[i].size,
+				attribs[i].type, stride, offset);
+		} else {
+			glVertexAttribPointer(first + i, attribs[i].size,
+				attribs[i].type, attribs[i].normalized, stride,
+				offset);
+		}
+		glVertexAttribDivisor(first + i, 1);
+		glEnableVertexAttribArray(first + i);
+	}
+}
+
 // =============================================================================
 // fade shader
 // =============================================================================
@@ -110,13 +439,8 @@ static const char *fade_frag_shader_src = SHADER_SRC(
 
 i32 init_fade(void) {
 	// TODO -- error checking
-	fade_vert_shader = compile_shader(GL_VERTEX_SHADER,   fade_vert_shader_src);
-	fade_frag_shader = compile_shader(GL_FRAGMENT_SHADER, fade_frag_shader_src);
-
-	fade_program = glCreateProgram();
-	glAttachShader(fade_program, fade_vert_shader);
-	glAttachShader(fade_program, fade_frag_shader);
-	fade_program = link_program(fade_program);
+	fade_program = create_program(fade_vert_shader_src, fade_frag_shader_src,
+		&fade_vert_shader, &fade_frag_shader);
 
 	fade_color_loc = glGetUniformLocation(fade_program, "fade_color");
 
@@ -161,9 +485,11 @@ void draw_fade(void) {
 // cube shader
 // =============================================================================
 
-static GLuint cube_static_buffer, cube_index_buffer, cube_buffer, cube_vao;
+static GLuint cube_static_buffer, cube_index_buffer, cube_vao;
+static struct instance_stream cube_stream;
 static GLuint cube_program, cube_vert_shader, cube_frag_shader;
 static GLint cube_proj_mat_loc, cube_ambient_loc, cube_directional_loc, cube_light_dir_loc;
+static GLint cube_time_loc;
 
 struct cube_static_vertex {
 	struct {
@@ -212,19 +538,155 @@ static u16 cube_static_indices[] = {
 	16, 20, 18, 20, 22, 18,
 };
 
+// struct cube_params as uploaded.
+struct cube_instance {
+	struct packed_motion motion;
+	i16 pos[3];
+	u8 color[3];
+};
+
 static u32 num_cubes;
 static struct cube_params cube_instance_params[MAX_CUBES];
 
+// A camera's position and unit view direction.
+struct view {
+	struct {
+		f32 x, y, z;
+	} pos, dir;
+};
+
+// From set_camera.
+static struct view view;
+
+static struct view camera_view(struct camera_params params) {
+	f32 dx = params.look_at.x - params.camera_pos.x;
+	f32 dy = params.look_at.y - params.camera_pos.y;
+	f32 dz = params.look_at.z - params.camera_pos.z;
+	f32 look_dist = sqrt(dx*dx + dy*dy + dz*dz);
+	struct view v;
+	v.pos.x = params.camera_pos.x;
+	v.pos.y = params.camera_pos.y;
+	v.pos.z = params.camera_pos.z;
+	v.dir.x = dx / look_dist;
+	v.dir.y = dy / look_dist;
+	v.dir.z = dz / look_dist;
+	return v;
+}
+
+static u8 same_view(const struct view *a, const struct view *b) {
+	return a->pos.x == b->pos.x && a->pos.y == b->pos.y
+		&& a->pos.z == b->pos.z && a->dir.x == b->dir.x
+		&& a->dir.y == b->dir.y && a->dir.z == b->dir.z;
+}
+
+static f32 view_depth(const struct view *v, f32 x, f32 y, f32 z) {
+	return (x - v->pos.x) * v->dir.x
+		+ (y - v->pos.y) * v->dir.y
+		+ (z - v->pos.z) * v->dir.z;
+}
+
+// Cubes are uploaded and drawn nearest first, so the depth test can throw
+// away the fragments of those behind before they're shaded. cube_order holds
+// the instances in draw order, cube_sorted_instances their packed params in
+// that order, and cube_order_pos where each instance is in it.
+static f32 cube_depths[MAX_CUBES];
+static u32 cube_order[MAX_CUBES];
+static u32 cube_order_pos[MAX_CUBES];
+static struct cube_instance cube_sorted_instances[MAX_CUBES];
+// Set when the order needs building from scratch.
+static u8 cube_order_stale;
+
+static struct cube_instance pack_cube(struct cube_params *params) {
+	struct cube_instance instance;
+	pack_idle(&instance.motion, params->idle);
+	pack_motion(&instance.motion, params->motion);
+	instance.pos[0]   = pack_fixed(params->x);
+	instance.pos[1]   = pack_fixed(params->y);
+	instance.pos[2]   = pack_fixed(params->z);
+	instance.color[0] = pack_unorm8(params->r);
+	instance.color[1] = pack_unorm8(params->g);
+	instance.color[2] = pack_unorm8(params->b);
+	return instance;
+}
+
+static f32 cube_depth(struct cube_params *params) {
+	return view_depth(&view, params->x, params->y, params->z);
+}
+
+static int compare_cube_depths(const void *a, const void *b) {
+	f32 da = cube_depths[*(const u32 *)a];
+	f32 db = cube_depths[*(const u32 *)b];
+	return (da > db) - (da < db);
+}
+
+static void sort_cubes(void) {
+	for (u32 i = 0; i < num_cubes; ++i) {
+		cube_depths[i] = cube_depth(&cube_instance_params[i]);
+		cube_order[i] = i;
+	}
+	qsort(cube_order, num_cubes, sizeof(cube_order[0]),
+		compare_cube_depths);
+	for (u32 i = 0; i < num_cubes; ++i) {
+		cube_order_pos[cube_order[i]] = i;
+		cube_sorted_instances[i]
+			= pack_cube(&cube_instance_params[cube_order[i]]);
+	}
+	mark_stream_dirty(&cube_stream, 0, num_cubes);
+	cube_order_stale = 0;
+}
+
+// Only a few cubes move each turn, so each is slid along the order to its
+// new place rather than sorting everything again.
+static void resort_cube(u32 cube) {
+	u32 start = cube_order_pos[cube], i = start;
+	f32 depth = cube_depths[cube] = cube_depth(&cube_instance_params[cube]);
+	while (i > 0 && cube_depths[cube_order[i - 1]] > depth) {
+		cube_order[i] = cube_order[i - 1];
+		cube_order_pos[cube_order[i]] = i;
+		--i;
+	}
+	while (i + 1 < num_cubes && cube_depths[cube_order[i + 1]] < depth) {
+		cube_order[i] = cube_order[i + 1];
+		cube_order_pos[cube_order[i]] = i;
+		++i;
+	}
+	cube_order[i] = cube;
+	cube_order_pos[cube] = i;
+	u32 lo = MIN(start, i), hi = MAX(start, i) + 1;
+	for (u32 j = lo; j < hi; ++j) {
+		cube_sorted_instances[j]
+			= pack_cube(&cube_instance_params[cube_order[j]]);
+	}
+	mark_stream_dirty(&cube_stream, lo, hi);
+}
+
 void reset_cubes(void) {
 	num_cubes = 0;
+	reset_stream(&cube_stream);
+	cube_order_stale = 1;
 }
 
-void add_cube(struct cube_params params) {
+u32 add_cube(struct cube_params params) {
 	assert(num_cubes < MAX_CUBES);
-	cube_instance_params[num_cubes++] = params;
+	cube_instance_params[num_cubes] = params;
+	cube_order_stale = 1;
+	return num_cubes++;
 }
 
-static const char *cube_vert_shader_src = SHADER_SRC(
+void set_cube_motion(u32 cube, f32 x, f32 y, f32 z,
+		struct motion_params motion) {
+	assert(cube < num_cubes);
+	struct cube_params *params = &cube_instance_params[cube];
+	params->x = x;
+	params->y = y;
+	params->z = z;
+	params->motion = motion;
+	if (!cube_order_stale) {
+		resort_cube(cube);
+	}
+}
+
+static const char *cube_vert_shader_src = SHADER_SRC_WITH_MOTION(
 	uniform mat4 projection_matrix;
 	uniform vec3 ambient_light;
 	uniform vec3 directional_light;
@@ -234,12 +696,26 @@ static const char *cube_vert_shader_src = SHADER_SRC(
 	layout (location = 1) in vec3 normal;
 	layout (location = 2) in vec3 color;
 	layout (location = 3) in vec3 center_pos;
+	layout (location = 4) in vec3 idle_mag;
+	layout (location = 5) in vec3 idle_off;
+	layout (location = 6) in vec3 idle_freq;
+	layout (location = 7) in uint motion;
+	layout (location = 8) in float motion_start;
+	layout (location = 9) in float motion_duration;
+	layout (location = 10) in vec3 motion_from;
 
 	out vec3 through_color;
 
 	void main() {
+		vec2 motion_timing = vec2(motion_start, motion_duration);
+		if (motion_hidden(motion, motion_timing)) {
+			gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+			return;
+		}
 		through_color = color * (ambient_light + dot(-light_direction, normal) * directional_light);
-		vec3 pos = 0.95f * vertex_pos + center_pos;
+		vec3 center = animate(center_pos, motion, motion_timing, motion_from,
+			idle_mag, idle_off, idle_freq);
+		vec3 pos = 0.95f * vertex_pos + center;
 		gl_Position = projection_matrix * vec4(pos, 1.0f);
 	}
 );
@@ -254,19 +730,37 @@ static const char *cube_frag_shader_src = SHADER_SRC(
 	}
 );
 
+// Points the instance attributes at the stream's current region. The VAO
+// must be bound.
+static void bind_cube_instances(void) {
+	GLintptr base = stream_base(&cube_stream);
+	glBindBuffer(GL_ARRAY_BUFFER, cube_stream.buffer);
+
+	glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE,
+		sizeof(struct cube_instance), (GLvoid*)(base + offsetof(struct cube_instance, color)));
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(2);
+
+	glVertexAttribPointer(3, 3, GL_SHORT, GL_FALSE,
+		sizeof(struct cube_instance), (GLvoid*)(base + offsetof(struct cube_instance, pos)));
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(3);
+
+	init_motion_attribs(4, sizeof(struct cube_instance),
+		base + offsetof(struct cube_instance, motion));
+}
+
 static i32 init_cube(void) {
 	// TODO -- error checking
-	cube_vert_shader = compile_shader(GL_VERTEX_SHADER,   cube_vert_shader_src);
-	cube_frag_shader = compile_shader(GL_FRAGMENT_SHADER, cube_frag_shader_src);
-	cube_program = glCreateProgram();
-	glAttachShader(cube_program, cube_vert_shader);
-	glAttachShader(cube_program, cube_frag_shader);
-	cube_program = link_program(cube_program);
+	cube_program = create_program(cube_vert_shader_src, cube_frag_shader_src,
+		&cube_vert_shader, &cube_frag_shader);
 
 	cube_proj_mat_loc    = glGetUniformLocation(cube_program, "projection_matrix");
 	cube_ambient_loc     = glGetUniformLocation(cube_program, "ambient_light");
 	cube_directional_loc = glGetUniformLocation(cube_program, "directional_light");
 	cube_light_dir_loc   = glGetUniformLocation(cube_program, "light_direction");
+	cube_time_loc        = glGetUniformLocation(cube_program, "time");
+	init_motion_uniforms(cube_program);
 
 	glGenVertexArrays(1, &cube_vao);
 	glBindVertexArray(cube_vao);
@@ -285,19 +779,8 @@ static i32 init_cube(void) {
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cube_index_buffer);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_static_indices), &cube_static_indices, GL_STATIC_DRAW);
 
-	glGenBuffers(1, &cube_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, cube_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cube_instance_params), NULL, GL_DYNAMIC_DRAW);
-
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,
-		sizeof(struct cube_params), (GLvoid*)offsetof(struct cube_params, r));
-	glVertexAttribDivisor(2, 1);
-	glEnableVertexAttribArray(2);
-
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE,
-		sizeof(struct cube_params), (GLvoid*)offsetof(struct cube_params, x));
-	glVertexAttribDivisor(3, 1);
-	glEnableVertexAttribArray(3);
+	init_stream(&cube_stream, sizeof(struct cube_instance), MAX_CUBES);
+	bind_cube_instances();
 
 	glBindVertexArray(0);
 
@@ -312,7 +795,7 @@ static void free_cube(void) {
 	glDeleteVertexArrays(1, &cube_vao);
 	glDeleteBuffers(1, &cube_static_buffer);
 	glDeleteBuffers(1, &cube_index_buffer);
-	glDeleteBuffers(1, &cube_buffer);
+	free_stream(&cube_stream);
 }
 
 static void set_cube_proj_mat(mat4 m) {
@@ -335,26 +818,322 @@ static void set_cube_light_direction(f32 x, f32 y, f32 z) {
 	glUniform3f(cube_light_dir_loc, x, y, z);
 }
 
+static void set_cube_time(f32 time) {
+	glUseProgram(cube_program);
+	glUniform1f(cube_time_loc, time);
+}
+
 static void draw_cubes(void) {
-	glBindBuffer(GL_ARRAY_BUFFER, cube_buffer);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, num_cubes * sizeof(struct cube_params), cube_instance_params);
 	glUseProgram(cube_program);
 	glBindVertexArray(cube_vao);
+	if (cube_order_stale) {
+		sort_cubes();
+	}
+	if (upload_stream(&cube_stream, cube_sorted_instances)) {
+		bind_cube_instances();
+	}
 	glDrawElementsInstanced(
 		GL_TRIANGLES,
 		ARRAY_LENGTH(cube_static_indices),
 		GL_UNSIGNED_SHORT,
 		(GLvoid*)0,
 		num_cubes);
+	fence_stream(&cube_stream);
+	++render_stats.draw_calls;
+	render_stats.triangles += num_cubes * ARRAY_LENGTH(cube_static_indices) / 3;
+}
+
+// =============================================================================
+// static cube mesh
+// =============================================================================
+
+// Half the size of a cube, and of one joined to a neighbour on that side.
+#define STATIC_CUBE_HALF  (0.95f * 0.5f)
+#define STATIC_JOIN_HALF  0.5f
+
+static GLuint static_buffer, static_index_buffer, static_vao;
+static GLuint static_program, static_vert_shader, static_frag_shader;
+static GLint static_proj_mat_loc, static_ambient_loc, static_directional_loc, static_light_dir_loc;
+
+struct static_vertex {
+	struct {
+		f32 x, y, z;
+	} pos;
+	struct {
+		f32 x, y, z;
+	} normal;
+	struct {
+		f32 r, g, b;
+	} color;
+};
+
+// A static cube's place in draw order.
+struct static_order {
+	f32 depth;
+	u32 cube;
+};
+
+struct static_mesh {
+	u32 num_cubes;
+	struct static_cube_params cubes[MAX_CUBES];
+	u8 cells[MAX_LEVEL_LAYERS][MAX_LEVEL_HEIGHT][MAX_LEVEL_WIDTH];
+	// What the mesh was last baked for, with the cubes nearest first.
+	struct view view;
+	struct static_order order[MAX_CUBES];
+	// At most six faces of four vertices a cube.
+	u32 num_vertices, num_indices, num_faces;
+	struct static_vertex vertices[MAX_CUBES * 6 * 4];
+	u16 indices[MAX_CUBES * 6 * 6];
+};
+
+// The mesh drawn, and one baked off the main thread for the next level by
+// bake_next_static_cubes.
+static struct static_mesh static_meshes[2];
+static struct static_mesh *static_mesh      = &static_meshes[0];
+static struct static_mesh *next_static_mesh = &static_meshes[1];
+
+static void clear_static_mesh(struct static_mesh *mesh) {
+	for (u32 i = 0; i < mesh->num_cubes; ++i) {
+		struct static_cube_params *c = &mesh->cubes[i];
+		mesh->cells[c->y][c->z][c->x] = 0;
+	}
+	mesh->num_cubes = 0;
+}
+
+static void put_static_cube(struct static_mesh *mesh,
+		struct static_cube_params params) {
+	assert(mesh->num_cubes < MAX_CUBES);
+	assert(params.x >= 0 && params.x < MAX_LEVEL_WIDTH
+		&& params.y >= 0 && params.y < MAX_LEVEL_LAYERS
+		&& params.z >= 0 && params.z < MAX_LEVEL_HEIGHT);
+	mesh->cubes[mesh->num_cubes++] = params;
+	mesh->cells[params.y][params.z][params.x] = 1;
+}
+
+static int compare_static_depths(const void *a, const void *b) {
+	f32 da = ((const struct static_order *)a)->depth;
+	f32 db = ((const struct static_order *)b)->depth;
+	return (da > db) - (da < db);
+}
+
+static u8 static_cell_filled(struct static_mesh *mesh, i32 x, i32 y, i32 z) {
+	if (x < 0 || x >= MAX_LEVEL_WIDTH
+			|| y < 0 || y >= MAX_LEVEL_LAYERS
+			|| z < 0 || z >= MAX_LEVEL_HEIGHT) {
+		return 0;
+	}
+	return mesh->cells[y][z][x];
+}
+
+// Emits each face of each cube that isn't against another static cube, nearest
+// cube first as for the instanced ones. A cube reaches all the way to a
+// neighbour it's joined to, so there's no gap to see the missing faces
+// through. Touches no GL, so the next level's can be baked on another thread.
+static void bake_static_mesh(struct static_mesh *mesh, struct view v) {
+	mesh->view = v;
+	mesh->num_vertices = 0;
+	mesh->num_indices = 0;
+	mesh->num_faces = 0;
+	for (u32 i = 0; i < mesh->num_cubes; ++i) {
+		struct static_cube_params *c = &mesh->cubes[i];
+		mesh->order[i].depth = view_depth(&v, c->x, c->y, c->z);
+		mesh->order[i].cube = i;
+	}
+	qsort(mesh->order, mesh->num_cubes, sizeof(mesh->order[0]),
+		compare_static_depths);
+	for (u32 i = 0; i < mesh->num_cubes; ++i) {
+		struct static_cube_params *c = &mesh->cubes[mesh->order[i].cube];
+		i32 cell[3] = { c->x, c->y, c->z };
+		u8 joined[3][2];
+		f32 lo[3], hi[3];
+		for (u32 a = 0; a < 3; ++a) {
+			for (u32 s = 0; s < 2; ++s) {
+				i32 n[3] = { cell[0], cell[1], cell[2] };
+				n[a] += s ? 1 : -1;
+				joined[a][s] = static_cell_filled(mesh, n[0], n[1], n[2]);
+			}
+			lo[a] = (f32)cell[a]
+				- (joined[a][0] ? STATIC_JOIN_HALF : STATIC_CUBE_HALF);
+			hi[a] = (f32)cell[a]
+				+ (joined[a][1] ? STATIC_JOIN_HALF : STATIC_CUBE_HALF);
+		}
+		for (u32 a = 0; a < 3; ++a) {
+			for (u32 s = 0; s < 2; ++s) {
+				if (joined[a][s]) {
+					continue;
+				}
+				// Corners in the order (lo, lo), (hi, lo), (lo, hi),
+				// (hi, hi) along the other two axes.
+				u32 u = (a + 1) % 3, v = (a + 2) % 3;
+				u32 first = mesh->num_vertices;
+				for (u32 k = 0; k < 4; ++k) {
+					f32 pos[3], normal[3] = { 0.0f, 0.0f, 0.0f };
+					pos[a] = s ? hi[a] : lo[a];
+					pos[u] = (k & 1) ? hi[u] : lo[u];
+					pos[v] = (k & 2) ? hi[v] : lo[v];
+					normal[a] = s ? 1.0f : -1.0f;
+					mesh->vertices[mesh->num_vertices++]
+						= (struct static_vertex){
+							.pos    = { pos[0], pos[1], pos[2] },
+							.normal = { normal[0], normal[1], normal[2] },
+							.color  = { c->r, c->g, c->b },
+						};
+				}
+				// Wound the same way as cube_static_indices.
+				static const u16 winding[2][6] = {
+					{ 0, 1, 2, 1, 3, 2 },
+					{ 0, 2, 1, 1, 2, 3 },
+				};
+				for (u32 k = 0; k < 6; ++k) {
+					mesh->indices[mesh->num_indices++]
+						= first + winding[s][k];
+				}
+				++mesh->num_faces;
+			}
+		}
+	}
+}
+
+static void upload_static_mesh(struct static_mesh *mesh) {
+	glBindBuffer(GL_ARRAY_BUFFER, static_buffer);
+	glBufferData(GL_ARRAY_BUFFER,
+		mesh->num_vertices * sizeof(struct static_vertex),
+		mesh->vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, static_index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		mesh->num_indices * sizeof(u16),
+		mesh->indices, GL_STATIC_DRAW);
+	SDL_LogDebug(SDL_LOG_CATEGORY_RENDER,
+		"Baked %u static cubes: %u of %u faces, %u triangles",
+		mesh->num_cubes, mesh->num_faces, mesh->num_cubes * 6,
+		mesh->num_indices / 3);
+}
+
+void bake_next_static_cubes(const struct static_cube_params *cubes,
+		u32 num_cubes, struct camera_params camera) {
+	clear_static_mesh(next_static_mesh);
+	for (u32 i = 0; i < num_cubes; ++i) {
+		put_static_cube(next_static_mesh, cubes[i]);
+	}
+	bake_static_mesh(next_static_mesh, camera_view(camera));
+}
+
+void use_next_static_cubes(void) {
+	struct static_mesh *mesh = static_mesh;
+	static_mesh = next_static_mesh;
+	next_static_mesh = mesh;
+	glBindVertexArray(static_vao);
+	upload_static_mesh(static_mesh);
+	glBindVertexArray(0);
+}
+
+static const char *static_vert_shader_src = SHADER_SRC(
+	uniform mat4 projection_matrix;
+	uniform vec3 ambient_light;
+	uniform vec3 directional_light;
+	uniform vec3 light_direction;
+
+	layout (location = 0) in vec3 vertex_pos;
+	layout (location = 1) in vec3 normal;
+	layout (location = 2) in vec3 color;
+
+	out vec3 through_color;
+
+	void main() {
+		through_color = color * (ambient_light + dot(-light_direction, normal) * directional_light);
+		gl_Position = projection_matrix * vec4(vertex_pos, 1.0f);
+	}
+);
+
+static i32 init_static(void) {
+	// TODO -- error checking
+	static_program = create_program(static_vert_shader_src, cube_frag_shader_src,
+		&static_vert_shader, &static_frag_shader);
+
+	static_proj_mat_loc    = glGetUniformLocation(static_program, "projection_matrix");
+	static_ambient_loc     = glGetUniformLocation(static_program, "ambient_light");
+	static_directional_loc = glGetUniformLocation(static_program, "directional_light");
+	static_light_dir_loc   = glGetUniformLocation(static_program, "light_direction");
+
+	glGenVertexArrays(1, &static_vao);
+	glBindVertexArray(static_vao);
+
+	glGenBuffers(1, &static_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, static_buffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
+		sizeof(struct static_vertex), (GLvoid*)offsetof(struct static_vertex, pos));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
+		sizeof(struct static_vertex), (GLvoid*)offsetof(struct static_vertex, normal));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,
+		sizeof(struct static_vertex), (GLvoid*)offsetof(struct static_vertex, color));
+	glEnableVertexAttribArray(2);
+
+	glGenBuffers(1, &static_index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, static_index_buffer);
+
+	glBindVertexArray(0);
+
+	return 0;
+}
+
+static void free_static(void) {
+	glDeleteProgram(static_program);
+	glDeleteShader(static_vert_shader);
+	glDeleteShader(static_frag_shader);
+
+	glDeleteVertexArrays(1, &static_vao);
+	glDeleteBuffers(1, &static_buffer);
+	glDeleteBuffers(1, &static_index_buffer);
+}
+
+static void set_static_proj_mat(mat4 m) {
+	glUseProgram(static_program);
+	glUniformMatrix4fv(static_proj_mat_loc, 1, GL_TRUE, m.elems);
+}
+
+static void set_static_ambient_light(f32 r, f32 g, f32 b) {
+	glUseProgram(static_program);
+	glUniform3f(static_ambient_loc, r, g, b);
+}
+
+static void set_static_directional_light(f32 r, f32 g, f32 b) {
+	glUseProgram(static_program);
+	glUniform3f(static_directional_loc, r, g, b);
+}
+
+static void set_static_light_direction(f32 x, f32 y, f32 z) {
+	glUseProgram(static_program);
+	glUniform3f(static_light_dir_loc, x, y, z);
+}
+
+static void draw_static(void) {
+	glBindVertexArray(static_vao);
+	// Only a camera move since the mesh was baked calls for another.
+	if (!same_view(&static_mesh->view, &view)) {
+		bake_static_mesh(static_mesh, view);
+		upload_static_mesh(static_mesh);
+	}
+	if (static_mesh->num_indices == 0) {
+		return;
+	}
+	glUseProgram(static_program);
+	glDrawElements(GL_TRIANGLES, static_mesh->num_indices, GL_UNSIGNED_SHORT,
+		(GLvoid*)0);
+	++render_stats.draw_calls;
+	render_stats.triangles += static_mesh->num_indices / 3;
 }
 
 // =============================================================================
 // font shader
 // =============================================================================
 
-static GLuint font_static_buffer, font_buffer, font_vao;
+static GLuint font_static_buffer, font_vao;
+static struct instance_stream font_stream;
 GLuint font_vert_shader, font_frag_shader, font_program;
 static GLint screen_size_loc, glyph_tex_size_loc, glyph_screen_size_loc, font_tex_loc;
+static GLint font_time_loc;
 
 struct font_static_vertex {
 	f32 x, y;
@@ -370,34 +1149,66 @@ static struct font_static_vertex font_static_vertices[] = {
 	{ .x = 0.0f, .y = 1.0f },
 };
 
+// The position is fixed point, and glyph holds the character and the zoom in
+// eighths. A zoom of 0 leaves a slot empty. The flash is the text's, copied
+// to each of its glyphs, with a half float duration.
 struct font_instance_params {
-	f32 x, y;
-	f32 zoom;
-	u8 character;
-	f32 r, g, b;
+	f32 flash_start;
+	i16 x, y;
+	u16 flash_duration;
+	u8 color[3];
+	u8 glyph[2];
+	u8 num_flashes;
 };
 
-static u32 num_chars;
+#define FONT_ZOOM_ONE 8.0f
+
+// Each text owns MAX_TEXT_LENGTH glyph slots in font_instances, from
+// text * MAX_TEXT_LENGTH on, which are only written when it changes.
+#define MAX_TEXTS       (MAX_LETTERS / MAX_TEXT_LENGTH)
+
+struct text {
+	char string[MAX_TEXT_LENGTH + 1];
+	struct color color;
+	f32 zoom, x, y;
+	f32 flash_start, flash_duration;
+	u32 num_flashes;
+};
+
+static u32 num_texts;
+static struct text texts[MAX_TEXTS];
 static struct font_instance_params font_instances[MAX_LETTERS];
 
 static const char *font_vert_shader_src = SHADER_SRC(
 	uniform vec2 screen_size;
 	uniform vec2 glyph_screen_size;
 	uniform vec2 glyph_tex_size;
+	uniform float time;
 
 	layout (location = 0) in vec2 pos;
-	layout (location = 1) in vec2 screen_pos;
-	layout (location = 2) in float zoom;
-	layout (location = 3) in uint character;
-	layout (location = 4) in vec3 color_in;
+	layout (location = 1) in vec2 fixed_screen_pos;
+	layout (location = 2) in uvec2 glyph;
+	layout (location = 3) in vec3 color_in;
+	layout (location = 4) in float flash_start;
+	layout (location = 5) in float flash_duration;
+	layout (location = 6) in uint num_flashes;
 
 	out vec2 tex_coord;
 	out vec3 color;
 
 	void main() {
+		// As FIXED_ONE and FONT_ZOOM_ONE.
+		vec2 screen_pos = fixed_screen_pos / 256.0f;
+		uint character = glyph.x;
+		float zoom = float(glyph.y) / 8.0f;
 		vec2 glyph_loc = vec2(character % 32u, 7u - (character / 32u));
 		tex_coord = (glyph_loc + pos) * glyph_tex_size;
 		color = color_in;
+		float flash_dt = (time - flash_start) / flash_duration;
+		if (num_flashes != 0u && flash_dt >= 0.0f && flash_dt <= 1.0f
+				&& uint(flash_dt * float(num_flashes)) % 2u == 0u) {
+			color = vec3(1.0f, 1.0f, 1.0f);
+		}
 		vec2 out_pos = (screen_pos + pos) * zoom * glyph_screen_size;
 		out_pos.y += 1.0f - zoom * glyph_screen_size.y;
 		out_pos = 2.0f * out_pos - 1.0f;
@@ -414,27 +1225,60 @@ static const char *font_frag_shader_src = SHADER_SRC(
 	in vec2 tex_coord;
 
 	void main() {
-		vec4 color_sample = texture(font_tex, tex_coord);
-		if (color_sample.a == 0.0f) {
+		float coverage = texture(font_tex, tex_coord).r;
+		if (coverage == 0.0f) {
 			discard;
 		}
-		color_out = vec4(color_sample.rgb * color, 1.0f);
+		color_out = vec4(coverage * color, 1.0f);
 	}
 );
 
+// As for bind_cube_instances.
+static void bind_font_instances(void) {
+	GLintptr base = stream_base(&font_stream);
+	glBindBuffer(GL_ARRAY_BUFFER, font_stream.buffer);
+
+	glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE,
+		sizeof(struct font_instance_params), (GLvoid*)(base + offsetof(struct font_instance_params, x)));
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribIPointer(2, 2, GL_UNSIGNED_BYTE,
+		sizeof(struct font_instance_params), (GLvoid*)(base + offsetof(struct font_instance_params, glyph)));
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(2);
+
+	glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE,
+		sizeof(struct font_instance_params), (GLvoid*)(base + offsetof(struct font_instance_params, color)));
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(3);
+
+	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE,
+		sizeof(struct font_instance_params), (GLvoid*)(base + offsetof(struct font_instance_params, flash_start)));
+	glVertexAttribDivisor(4, 1);
+	glEnableVertexAttribArray(4);
+
+	glVertexAttribPointer(5, 1, GL_HALF_FLOAT, GL_FALSE,
+		sizeof(struct font_instance_params), (GLvoid*)(base + offsetof(struct font_instance_params, flash_duration)));
+	glVertexAttribDivisor(5, 1);
+	glEnableVertexAttribArray(5);
+
+	glVertexAttribIPointer(6, 1, GL_UNSIGNED_BYTE,
+		sizeof(struct font_instance_params), (GLvoid*)(base + offsetof(struct font_instance_params, num_flashes)));
+	glVertexAttribDivisor(6, 1);
+	glEnableVertexAttribArray(6);
+}
+
 static i32 init_font(void) {
 	// TODO -- error checking
-	font_vert_shader = compile_shader(GL_VERTEX_SHADER,   font_vert_shader_src);
-	font_frag_shader = compile_shader(GL_FRAGMENT_SHADER, font_frag_shader_src);
-	font_program = glCreateProgram();
-	glAttachShader(font_program, font_vert_shader);
-	glAttachShader(font_program, font_frag_shader);
-	font_program = link_program(font_program);
+	font_program = create_program(font_vert_shader_src, font_frag_shader_src,
+		&font_vert_shader, &font_frag_shader);
 
 	screen_size_loc       = glGetUniformLocation(font_program, "screen_size");
 	glyph_tex_size_loc    = glGetUniformLocation(font_program, "glyph_tex_size");
 	glyph_screen_size_loc = glGetUniformLocation(font_program, "glyph_screen_size");
 	font_tex_loc          = glGetUniformLocation(font_program, "font_tex");
+	font_time_loc         = glGetUniformLocation(font_program, "time");
 	// SDL_Log("%d %d %d %d", screen_size_loc, glyph_tex_size_loc, glyph_screen_size_loc, font_tex_loc);
 
 	glUseProgram(font_program);
@@ -457,29 +1301,9 @@ static i32 init_font(void) {
 		sizeof(struct font_static_vertex), (GLvoid*)offsetof(struct font_static_vertex, x));
 	glEnableVertexAttribArray(0);
 
-	glGenBuffers(1, &font_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, font_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(font_instances), NULL, GL_DYNAMIC_DRAW);
-
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
-		sizeof(struct font_instance_params), (GLvoid*)offsetof(struct font_instance_params, x));
-	glVertexAttribDivisor(1, 1);
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE,
-		sizeof(struct font_instance_params), (GLvoid*)offsetof(struct font_instance_params, zoom));
-	glVertexAttribDivisor(2, 1);
-	glEnableVertexAttribArray(2);
-
-	glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE,
-		sizeof(struct font_instance_params), (GLvoid*)offsetof(struct font_instance_params, character));
-	glVertexAttribDivisor(3, 1);
-	glEnableVertexAttribArray(3);
-
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE,
-		sizeof(struct font_instance_params), (GLvoid*)offsetof(struct font_instance_params, r));
-	glVertexAttribDivisor(4, 1);
-	glEnableVertexAttribArray(4);
+	init_stream(&font_stream,
+		sizeof(struct font_instance_params), MAX_LETTERS);
+	bind_font_instances();
 
 	glBindVertexArray(0);
 
@@ -492,49 +1316,117 @@ static void free_font(void) {
 	glDeleteShader(font_frag_shader);
 
 	glDeleteBuffers(1, &font_static_buffer);
-	glDeleteBuffers(1, &font_buffer);
+	free_stream(&font_stream);
 }
 
-void reset_characters(void) {
-	num_chars = 0;
+static void set_font_time(f32 time) {
+	glUseProgram(font_program);
+	glUniform1f(font_time_loc, time);
 }
 
-static void add_character(struct font_instance_params params) {
-	assert(num_chars < MAX_LETTERS);
-	font_instances[num_chars++] = params;
+void reset_characters(void) {
+	num_texts = 0;
+	reset_stream(&font_stream);
 }
 
-void add_string(char *string, struct color color, f32 zoom, f32 x, f32 y) {
+static void write_text_glyphs(u32 text) {
+	struct text *t = &texts[text];
+	struct font_instance_params *glyphs
+		= &font_instances[text * MAX_TEXT_LENGTH];
+	memset(glyphs, 0, MAX_TEXT_LENGTH * sizeof(*glyphs));
 	struct font_instance_params params;
-	params.x = x;
-	params.y = y;
-	params.r = color.r;
-	params.g = color.g;
-	params.b = color.b;
-	params.zoom = zoom;
-	for (char *p = string; *p; ++p) {
-		params.character = (u8)*p;
-		add_character(params);
-		params.x += 1.0f;
+	params.flash_start    = t->flash_start;
+	params.flash_duration = pack_half(t->flash_duration);
+	params.num_flashes    = t->num_flashes;
+	params.y = pack_fixed(t->y);
+	params.color[0] = pack_unorm8(t->color.r);
+	params.color[1] = pack_unorm8(t->color.g);
+	params.color[2] = pack_unorm8(t->color.b);
+	params.glyph[1] = (u8)lrintf(t->zoom * FONT_ZOOM_ONE);
+	f32 x = t->x;
+	for (u32 i = 0; t->string[i]; ++i) {
+		params.x = pack_fixed(x);
+		params.glyph[0] = (u8)t->string[i];
+		glyphs[i] = params;
+		x += 1.0f;
 	}
+	mark_stream_dirty(&font_stream,
+		text * MAX_TEXT_LENGTH, (text + 1) * MAX_TEXT_LENGTH);
+}
+
+// Copies at most MAX_TEXT_LENGTH characters of src.
+static void copy_text_string(char *dst, const char *src) {
+	u32 len = 0;
+	while (len < MAX_TEXT_LENGTH && src[len]) {
+		dst[len] = src[len];
+		++len;
+	}
+	dst[len] = '\0';
+}
+
+u32 add_text(char *string, struct color color, f32 zoom, f32 x, f32 y) {
+	assert(num_texts < MAX_TEXTS);
+	assert(zoom > 0.0f && zoom * FONT_ZOOM_ONE < 256.0f);
+	struct text *t = &texts[num_texts];
+	memset(t, 0, sizeof(*t));
+	t->zoom = zoom;
+	t->x = x;
+	t->y = y;
+	t->color = color;
+	copy_text_string(t->string, string);
+	write_text_glyphs(num_texts);
+	return num_texts++;
+}
+
+void set_text(u32 text, char *string, struct color color) {
+	assert(text < num_texts);
+	struct text *t = &texts[text];
+	char truncated[MAX_TEXT_LENGTH + 1];
+	copy_text_string(truncated, string);
+	if (strcmp(t->string, truncated) == 0 && t->color.r == color.r
+			&& t->color.g == color.g && t->color.b == color.b) {
+		return;
+	}
+	strcpy(t->string, truncated);
+	t->color = color;
+	write_text_glyphs(text);
+}
+
+void flash_text(u32 text, f32 start_time, f32 duration, u32 num_flashes) {
+	assert(text < num_texts);
+	struct text *t = &texts[text];
+	t->flash_start    = start_time;
+	t->flash_duration = duration;
+	t->num_flashes    = num_flashes;
+	write_text_glyphs(text);
 }
 
 void draw_characters(void) {
-	glBindBuffer(GL_ARRAY_BUFFER, font_buffer);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, num_chars * sizeof(struct font_instance_params), font_instances);
+	if (num_texts == 0) {
+		return;
+	}
+	u32 num_slots = num_texts * MAX_TEXT_LENGTH;
 	glUseProgram(font_program);
 	glBindVertexArray(font_vao);
-	glDrawArraysInstanced(GL_TRIANGLES, 0, ARRAY_LENGTH(font_static_vertices), num_chars);
+	if (upload_stream(&font_stream, font_instances)) {
+		bind_font_instances();
+	}
+	glDrawArraysInstanced(GL_TRIANGLES, 0, ARRAY_LENGTH(font_static_vertices), num_slots);
+	fence_stream(&font_stream);
+	++render_stats.draw_calls;
+	render_stats.triangles += num_slots * ARRAY_LENGTH(font_static_vertices) / 3;
 }
 
 // =============================================================================
 // item
 // =============================================================================
 
-static GLuint item_static_buffer, item_buffer, item_vao;
+static GLuint item_static_buffer, item_vao;
+static struct instance_stream item_stream;
 GLuint item_vert_shader, item_frag_shader, item_program;
 static GLint item_glyph_tex_size_loc, item_font_tex_loc;
 static GLint item_proj_mat_loc, item_ambient_loc, item_directional_loc, item_light_dir_loc;
+static GLint item_time_loc;
 
 struct item_static_vertex {
 	struct {
@@ -559,9 +1451,17 @@ static struct item_static_vertex item_static_vertices[] = {
 };
 
 static u32 num_items;
-static struct item_params item_instances[MAX_ITEMS];
+// struct item_params as uploaded.
+struct item_instance {
+	struct packed_motion motion;
+	i16 pos[3];
+	u8 color[3];
+	u8 character;
+};
+
+static struct item_instance item_instances[MAX_ITEMS];
 
-static const char *item_vert_shader_src = SHADER_SRC(
+static const char *item_vert_shader_src = SHADER_SRC_WITH_MOTION(
 	uniform vec2 glyph_tex_size;
 
 	uniform mat4 projection_matrix;
@@ -575,17 +1475,30 @@ static const char *item_vert_shader_src = SHADER_SRC(
 	layout (location = 3) in vec3 color_in;
 	layout (location = 4) in vec3 center_pos;
 	layout (location = 5) in uint character;
+	layout (location = 6) in vec3 idle_mag;
+	layout (location = 7) in vec3 idle_off;
+	layout (location = 8) in vec3 idle_freq;
+	layout (location = 9) in uint motion;
+	layout (location = 10) in float motion_start;
+	layout (location = 11) in float motion_duration;
+	layout (location = 12) in vec3 motion_from;
 
 	out vec2 tex_coord;
 	out vec3 color;
 
 	void main() {
+		vec2 motion_timing = vec2(motion_start, motion_duration);
+		if (motion_hidden(motion, motion_timing)) {
+			gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+			return;
+		}
 		vec2 glyph_loc = vec2(character % 32u, 7u - (character / 32u));
 		tex_coord = (tex_in + glyph_loc) * glyph_tex_size;
 		// tex_coord = tex_in;
 		color = color_in;
 		// color = color_in * (ambient_light + dot(-light_direction, normal) * directional_light);
-		vec3 pos = vertex_pos + center_pos;
+		vec3 pos = vertex_pos + animate(center_pos, motion, motion_timing,
+			motion_from, idle_mag, idle_off, idle_freq);
 		gl_Position = projection_matrix * vec4(pos, 1.0f);
 		// gl_Position = vec4((center_pos.xy + vertex_pos.xy) * 0.1f, 0.0f, 1.0f);
 	}
@@ -601,23 +1514,43 @@ static const char *item_frag_shader_src = SHADER_SRC(
 
 	void main() {
 		// color_out = vec4(1.0f, 1.0f, 1.0f, 1.0f);
-		vec4 color_sample = texture(font_tex, tex_coord);
-		if (color_sample.a == 0.0f) {
+		float coverage = texture(font_tex, tex_coord).r;
+		if (coverage == 0.0f) {
 			discard;
 		}
-		color_out = vec4(color_sample.rgb * color, 1.0f);
+		color_out = vec4(coverage * color, 1.0f);
 		// color_out = vec4(tex_coord.xy, 0.0f, 1.0f);
 	}
 );
 
+// As for bind_cube_instances.
+static void bind_item_instances(void) {
+	GLintptr base = stream_base(&item_stream);
+	glBindBuffer(GL_ARRAY_BUFFER, item_stream.buffer);
+
+	glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE,
+		sizeof(struct item_instance), (GLvoid*)(base + offsetof(struct item_instance, color)));
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(3);
+
+	glVertexAttribPointer(4, 3, GL_SHORT, GL_FALSE,
+		sizeof(struct item_instance), (GLvoid*)(base + offsetof(struct item_instance, pos)));
+	glVertexAttribDivisor(4, 1);
+	glEnableVertexAttribArray(4);
+
+	glVertexAttribIPointer(5, 1, GL_UNSIGNED_BYTE,
+		sizeof(struct item_instance), (GLvoid*)(base + offsetof(struct item_instance, character)));
+	glVertexAttribDivisor(5, 1);
+	glEnableVertexAttribArray(5);
+
+	init_motion_attribs(6, sizeof(struct item_instance),
+		base + offsetof(struct item_instance, motion));
+}
+
 static i32 init_item(void) {
 	// TODO -- error checking
-	item_vert_shader = compile_shader(GL_VERTEX_SHADER,   item_vert_shader_src);
-	item_frag_shader = compile_shader(GL_FRAGMENT_SHADER, item_frag_shader_src);
-	item_program = glCreateProgram();
-	glAttachShader(item_program, item_vert_shader);
-	glAttachShader(item_program, item_frag_shader);
-	item_program = link_program(item_program);
+	item_program = create_program(item_vert_shader_src, item_frag_shader_src,
+		&item_vert_shader, &item_frag_shader);
 
 	item_glyph_tex_size_loc = glGetUniformLocation(item_program, "glyph_tex_size");
 	item_font_tex_loc       = glGetUniformLocation(item_program, "font_tex");
@@ -625,6 +1558,8 @@ static i32 init_item(void) {
 	item_ambient_loc        = glGetUniformLocation(item_program, "ambient_light");
 	item_directional_loc    = glGetUniformLocation(item_program, "directional_light");
 	item_light_dir_loc      = glGetUniformLocation(item_program, "light_direction");
+	item_time_loc           = glGetUniformLocation(item_program, "time");
+	init_motion_uniforms(item_program);
 
 	glUseProgram(item_program);
 	glUniform2f(item_glyph_tex_size_loc,
@@ -650,24 +1585,8 @@ static i32 init_item(void) {
 		sizeof(struct item_static_vertex), (GLvoid*)offsetof(struct item_static_vertex, tex));
 	glEnableVertexAttribArray(2);
 
-	glGenBuffers(1, &item_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, item_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(item_instances), NULL, GL_DYNAMIC_DRAW);
-
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE,
-		sizeof(struct item_params), (GLvoid*)offsetof(struct item_params, r));
-	glVertexAttribDivisor(3, 1);
-	glEnableVertexAttribArray(3);
-
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE,
-		sizeof(struct item_params), (GLvoid*)offsetof(struct item_params, x));
-	glVertexAttribDivisor(4, 1);
-	glEnableVertexAttribArray(4);
-
-	glVertexAttribIPointer(5, 1, GL_UNSIGNED_BYTE,
-		sizeof(struct item_params), (GLvoid*)offsetof(struct item_params, character));
-	glVertexAttribDivisor(5, 1);
-	glEnableVertexAttribArray(5);
+	init_stream(&item_stream, sizeof(struct item_instance), MAX_ITEMS);
+	bind_item_instances();
 
 	glBindVertexArray(0);
 
@@ -681,17 +1600,41 @@ static void free_item(void) {
 
 	// glDeleteVertexArrays...
 	glDeleteBuffers(1, &item_static_buffer);
-	glDeleteBuffers(1, &item_buffer);
+	free_stream(&item_stream);
 }
 
 void reset_items(void) {
 	num_items = 0;
+	reset_stream(&item_stream);
 }
 
-void add_item(struct item_params params) {
+u32 add_item(struct item_params params) {
 	assert(num_items < MAX_ITEMS);
-	item_instances[num_items++] = params;
+	mark_stream_dirty(&item_stream, num_items, num_items + 1);
+	struct item_instance *instance = &item_instances[num_items];
+	pack_idle(&instance->motion, params.idle);
+	pack_motion(&instance->motion, params.motion);
+	instance->pos[0]    = pack_fixed(params.x);
+	instance->pos[1]    = pack_fixed(params.y);
+	instance->pos[2]    = pack_fixed(params.z);
+	instance->color[0]  = pack_unorm8(params.r);
+	instance->color[1]  = pack_unorm8(params.g);
+	instance->color[2]  = pack_unorm8(params.b);
+	instance->character = params.character;
+	return num_items++;
+}
+
+void set_item_motion(u32 item, f32 x, f32 y, f32 z,
+		struct motion_params motion) {
+	assert(item < num_items);
+	struct item_instance *instance = &item_instances[item];
+	instance->pos[0] = pack_fixed(x);
+	instance->pos[1] = pack_fixed(y);
+	instance->pos[2] = pack_fixed(z);
+	pack_motion(&instance->motion, motion);
+	mark_stream_dirty(&item_stream, item, item + 1);
 }
+
 static void set_item_proj_mat(mat4 m) {
 	glUseProgram(item_program);
 	glUniformMatrix4fv(item_proj_mat_loc, 1, GL_TRUE, m.elems);
@@ -712,12 +1655,21 @@ static void set_item_light_direction(f32 x, f32 y, f32 z) {
 	glUniform3f(item_light_dir_loc, x, y, z);
 }
 
-void draw_items(void) {
-	glBindBuffer(GL_ARRAY_BUFFER, item_buffer);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, num_items * sizeof(struct item_params), item_instances);
+static void set_item_time(f32 time) {
+	glUseProgram(item_program);
+	glUniform1f(item_time_loc, time);
+}
+
+static void draw_items(void) {
 	glUseProgram(item_program);
 	glBindVertexArray(item_vao);
+	if (upload_stream(&item_stream, item_instances)) {
+		bind_item_instances();
+	}
 	glDrawArraysInstanced(GL_TRIANGLES, 0, ARRAY_LENGTH(item_static_vertices), num_items);
+	fence_stream(&item_stream);
+	++render_stats.draw_calls;
+	render_stats.triangles += num_items * ARRAY_LENGTH(item_static_vertices) / 3;
 }
 
 // =============================================================================
@@ -726,45 +1678,123 @@ void draw_items(void) {
 
 static GLuint cp437_tex;
 
-struct __attribute__((__packed__)) texture {
+// A texture read from disk and ready to upload.
+struct texture_file {
+	struct asset asset;
 	u16 width, height;
-	u32 pixels[0];
+	const u8 *texels;
+	// Set when the file was RGBA and texels had to be converted.
+	u8 *converted;
 };
 
-static GLuint load_texture(char *filename, GLenum texture_unit) {
-	// TODO -- error checking
-	char *base_path = SDL_GetBasePath();
-	u32 len = strlen(base_path) + strlen(filename) + 1;
-	char *full_filename = malloc(len * sizeof(char));
-	full_filename[0] = 0;
-	strcat(full_filename, base_path);
-	strcat(full_filename, filename);
-	SDL_free(base_path);
-	// SDL_Log("Loading texture: '%s'", full_filename);
-	FILE *fp = fopen(full_filename, "rb");
-	free(full_filename);
-	fseek(fp, 0, SEEK_END);
-	i32 filesize = ftell(fp);
-	struct texture *tex_data = malloc(filesize);
-	fseek(fp, 0, SEEK_SET);
-	fread(tex_data, filesize, 1, fp);
-	// SDL_Log("Texture size: (%hu x %hu)", tex_data->width, tex_data->height);
-	fclose(fp);
+static struct texture_file cp437_file;
+static SDL_Thread *texture_thread;
+
+static void free_texture_file(struct texture_file *tex) {
+	free(tex->converted);
+	tex->converted = NULL;
+	free_asset(&tex->asset);
+}
+
+// Old RGBA files are still read, and converted to coverage on the way in.
+// Touches no GL, so it can run off the main thread.
+static i32 read_texture(char *filename, struct texture_file *tex) {
+	if (load_asset(filename, &tex->asset)) {
+		goto error_load;
+	}
+	const struct texture *tex_data = (const struct texture *)tex->asset.data;
+	if (tex->asset.size < sizeof(struct texture)) {
+		SDL_Log("Texture '%s' is truncated", filename);
+		goto error_size;
+	}
+	u64 num_texels = (u64)tex_data->width * tex_data->height;
+	u64 texels_size = tex->asset.size - sizeof(struct texture);
+	tex->width     = tex_data->width;
+	tex->height    = tex_data->height;
+	tex->texels    = tex_data->texels;
+	tex->converted = NULL;
+	if (texels_size == 4 * num_texels && num_texels) {
+		tex->converted = malloc(num_texels);
+		if (tex->converted == NULL) {
+			SDL_Log("Out of memory loading texture '%s'", filename);
+			goto error_size;
+		}
+		for (u64 i = 0; i < num_texels; ++i) {
+			tex->converted[i] = rgba_coverage(&tex_data->texels[4 * i]);
+		}
+		tex->texels = tex->converted;
+	} else if (texels_size != num_texels) {
+		SDL_Log("Texture '%s' is truncated or not %hux%hu",
+			filename, tex_data->width, tex_data->height);
+		goto error_size;
+	}
+	return 0;
+
+error_size:
+	free_asset(&tex->asset);
+error_load:
+	return 1;
+}
+
+static GLuint upload_texture(struct texture_file *tex, GLenum texture_unit) {
 	GLuint texture;
 	glGenTextures(1, &texture);
 	glActiveTexture(GL_TEXTURE0 + texture_unit);
 	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, tex_data->width, tex_data->height, 0,
-		GL_RGBA, GL_UNSIGNED_BYTE, tex_data->pixels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, tex->width, tex->height, 0,
+		GL_RED, GL_UNSIGNED_BYTE, tex->texels);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	free(tex_data);
 	return texture;
 }
 
+static i32 read_textures(void *data) {
+	u64 start = SDL_GetPerformanceCounter();
+	if (read_texture("cp437.bin", &cp437_file)) {
+		return 1;
+	}
+	SDL_Log("Read textures in %.1f ms", (SDL_GetPerformanceCounter()
+		- start) * 1000.0 / SDL_GetPerformanceFrequency());
+	return 0;
+}
+
+void start_loading_textures(void) {
+	texture_thread = SDL_CreateThread(read_textures, "read_textures", NULL);
+	if (texture_thread == NULL) {
+		// load_textures reads them itself.
+		SDL_Log("Unable to start texture thread: %s", SDL_GetError());
+	}
+}
+
+static i32 finish_reading_textures(void) {
+	i32 result;
+	if (texture_thread) {
+		SDL_WaitThread(texture_thread, &result);
+		texture_thread = NULL;
+	} else {
+		result = read_textures(NULL);
+	}
+	return result;
+}
+
+void cancel_loading_textures(void) {
+	if (texture_thread) {
+		i32 result;
+		SDL_WaitThread(texture_thread, &result);
+		texture_thread = NULL;
+		if (result == 0) {
+			free_texture_file(&cp437_file);
+		}
+	}
+}
+
 static i32 load_textures(void) {
-	// TODO -- error checking
-	cp437_tex = load_texture("cp437.bin", FONT_TEX_LOC);
+	if (finish_reading_textures()) {
+		return 1;
+	}
+	cp437_tex = upload_texture(&cp437_file, FONT_TEX_LOC);
+	free_texture_file(&cp437_file);
 	return 0;
 }
 
@@ -778,24 +1808,34 @@ static void free_textures(void) {
 
 static void set_proj_mat(mat4 m) {
 	set_cube_proj_mat(m);
+	set_static_proj_mat(m);
 	set_item_proj_mat(m);
 }
 
 static void set_ambient_light(f32 r, f32 g, f32 b) {
 	set_cube_ambient_light(r, g, b);
+	set_static_ambient_light(r, g, b);
 	set_item_ambient_light(r, g, b);
 }
 
 static void set_directional_light(f32 r, f32 g, f32 b) {
 	set_cube_directional_light(r, g, b);
+	set_static_directional_light(r, g, b);
 	set_item_directional_light(r, g, b);
 }
 
 static void set_light_direction(f32 x, f32 y, f32 z) {
 	set_cube_light_direction(x, y, z);
+	set_static_light_direction(x, y, z);
 	set_item_light_direction(x, y, z);
 }
 
+void set_world_time(f32 time) {
+	set_cube_time(time);
+	set_item_time(time);
+	set_font_time(time);
+}
+
 void set_camera(struct camera_params params) {
 	struct { f32 x, y, z; } camera_pos, look_at;
 	camera_pos.x = params.camera_pos.x;
@@ -861,15 +1901,27 @@ void set_camera(struct camera_params params) {
 	proj_mat = mat_mul(scaling_matrix, proj_mat);
 	// print_matrix(proj_mat);
 	set_proj_mat(proj_mat);
+
+	// The static mesh is baked again if the view has changed.
+	view = camera_view(params);
+	cube_order_stale = 1;
 }
 
 i32 init_opengl(void) {
 	// TODO -- error checking
-	load_textures();
+	if (load_textures()) {
+		return 1;
+	}
+	open_program_cache();
 	init_fade();
 	init_cube();
+	init_static();
 	init_font();
 	init_item();
+	close_program_cache();
+	SDL_Log("Built %u shader programs, %u from the cache, in %.1f ms",
+		programs_built, programs_from_cache,
+		program_build_ticks * 1000.0 / SDL_GetPerformanceFrequency());
 
 	glEnable(GL_CULL_FACE);
 	glClearDepth(-1.0f);
@@ -887,6 +1939,7 @@ i32 init_opengl(void) {
 void quit_opengl(void) {
 	free_fade();
 	free_cube();
+	free_static();
 	free_font();
 	free_item();
 	free_textures();
@@ -895,6 +1948,9 @@ void quit_opengl(void) {
 void draw_world(void) {
 	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 	glEnable(GL_DEPTH_TEST);
+	// Opaque geometry first. Items discard texels, which stops early depth
+	// tests for them, so they go last where the most is already hidden.
+	draw_static();
 	draw_cubes();
 	draw_items();
 	glDisable(GL_DEPTH_TEST);
@@ -0,0 +1,56 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+
+// Packs the asset files given into one archive, each named by its file name,
+// for the game to map at startup in place of the loose files.
+i32 main(i32 argc, char *argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s out_archive asset...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	i32 exit_status = EXIT_FAILURE;
+	u32 num_assets = argc - 2;
+	const char *const *paths = (const char *const *)argv + 2;
+	struct mapped_file *assets = calloc(num_assets, sizeof(*assets));
+	if (assets == NULL) {
+		fprintf(stderr, "out of memory\n");
+		goto error_alloc;
+	}
+	u32 num_mapped = 0;
+	for (; num_mapped < num_assets; ++num_mapped) {
+		if (map_file(paths[num_mapped], &assets[num_mapped])) {
+			fprintf(stderr, "%s: %s\n", paths[num_mapped],
+				strerror(errno));
+			goto error_map;
+		}
+	}
+	FILE *out_file = fopen(argv[1], "wb");
+	if (out_file == NULL) {
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+		goto error_map;
+	}
+	if (write_archive(out_file, num_assets, paths, assets)) {
+		fprintf(stderr, "%s: write failed, or an asset name is over "
+			"%d bytes\n", argv[1], ARCHIVE_NAME_SIZE - 1);
+		fclose(out_file);
+		remove(argv[1]);
+		goto error_map;
+	}
+	if (fclose(out_file)) {
+		fprintf(stderr, "%s: write failed\n", argv[1]);
+		remove(argv[1]);
+		goto error_map;
+	}
+	exit_status = EXIT_SUCCESS;
+error_map:
+	for (u32 i = 0; i < num_mapped; ++i) {
+		unmap_file(&assets[i]);
+	}
+	free(assets);
+error_alloc:
+	return exit_status;
+}
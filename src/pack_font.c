@@ -0,0 +1,65 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "files.h"
+#include "texture.h"
+
+// Rewrites an RGBA texture file with one coverage byte a texel, which is what
+// the font atlas is uploaded as.
+i32 main(i32 argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s rgba_texture out_texture\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	i32 exit_status = EXIT_FAILURE;
+	struct mapped_file file;
+	if (map_file(argv[1], &file)) {
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+		goto error_map;
+	}
+	const struct texture *in = (const struct texture *)file.data;
+	if (file.size < sizeof(struct texture)) {
+		fprintf(stderr, "%s: truncated\n", argv[1]);
+		goto error_size;
+	}
+	u64 num_texels = (u64)in->width * in->height;
+	if (file.size - sizeof(struct texture) != 4 * num_texels) {
+		fprintf(stderr, "%s: not a %hux%hu RGBA texture\n", argv[1],
+			in->width, in->height);
+		goto error_size;
+	}
+	u64 out_size = sizeof(struct texture) + num_texels;
+	struct texture *out = malloc(out_size);
+	if (out == NULL) {
+		fprintf(stderr, "out of memory\n");
+		goto error_size;
+	}
+	out->width  = in->width;
+	out->height = in->height;
+	for (u64 i = 0; i < num_texels; ++i) {
+		out->texels[i] = rgba_coverage(&in->texels[4 * i]);
+	}
+	FILE *out_file = fopen(argv[2], "wb");
+	if (out_file == NULL) {
+		fprintf(stderr, "%s: %s\n", argv[2], strerror(errno));
+		goto error_open_out;
+	}
+	if (fwrite(out, out_size, 1, out_file) != 1) {
+		fprintf(stderr, "%s: write failed\n", argv[2]);
+		fclose(out_file);
+		goto error_open_out;
+	}
+	if (fclose(out_file)) {
+		fprintf(stderr, "%s: write failed\n", argv[2]);
+		goto error_open_out;
+	}
+	exit_status = EXIT_SUCCESS;
+error_open_out:
+	free(out);
+error_size:
+	unmap_file(&file);
+error_map:
+	return exit_status;
+}
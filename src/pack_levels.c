@@ -0,0 +1,252 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "files.h"
+#include "levels.h"
+
+// A level file is a few settings, one to a line:
+//   camera x y z              where the camera sits
+//   look_at x y z             the point it looks at
+//   size width height layers
+//   background r g b
+//   player r g b
+//   goal r g b
+//   color r g b health        once a colour, from colour 0 up
+// then a line reading "map" and the layers from the top down, each a row a
+// line from the back (highest z) forward. Blank lines between layers are
+// skipped, and short rows are padded with empty cells. In the map,
+//   .  empty    @  the player      !  the goal
+//   #  a grey cube, 1 2 3 a cube of that colour
+//   a b c  a heart of colour 1, 2 or 3
+#define SETTING_CAMERA     (1 << 0)
+#define SETTING_LOOK_AT    (1 << 1)
+#define SETTING_SIZE       (1 << 2)
+#define SETTING_BACKGROUND (1 << 3)
+#define SETTING_PLAYER     (1 << 4)
+#define SETTING_GOAL       (1 << 5)
+#define SETTING_COLOR      (1 << 6)
+#define SETTINGS_NEEDED    ((1 << 7) - 1)
+
+#define MAX_ROWS (MAX_LEVEL_LAYERS * MAX_LEVEL_HEIGHT)
+
+static char rows[MAX_ROWS][MAX_LEVEL_WIDTH + 1];
+
+// Returns the line, NUL terminated in place, and moves *text past it.
+static char *next_line(char **text) {
+	char *line = *text;
+	char *end = strchr(line, '\n');
+	if (end) {
+		*end = '\0';
+		*text = end + 1;
+	} else {
+		*text = line + strlen(line);
+	}
+	u32 len = strlen(line);
+	if (len && line[len - 1] == '\r') {
+		line[len - 1] = '\0';
+	}
+	return line;
+}
+
+static i32 color_of(char c) {
+	switch (c) {
+	case '1': case 'a': return 1;
+	case '2': case 'b': return 2;
+	case '3': case 'c': return 3;
+	}
+	return 0;
+}
+
+static i32 parse_level(const char *path, char *text, struct level *level) {
+	u32 settings = 0, line_num = 0;
+	u32 width = 0, height = 0, layers = 0;
+	struct color colors[MAX_COLORS];
+	u8 health[MAX_COLORS];
+	u32 num_colors = 0;
+	char *line;
+	while (*text) {
+		line = next_line(&text);
+		++line_num;
+		struct color c;
+		u32 h;
+		if (line[0] == '\0') {
+			continue;
+		} else if (strcmp(line, "map") == 0) {
+			break;
+		} else if (sscanf(line, "camera %f %f %f", &c.r, &c.g, &c.b) == 3) {
+			level->camera.camera_pos.x = c.r;
+			level->camera.camera_pos.y = c.g;
+			level->camera.camera_pos.z = c.b;
+			settings |= SETTING_CAMERA;
+		} else if (sscanf(line, "look_at %f %f %f", &c.r, &c.g, &c.b) == 3) {
+			level->camera.look_at.x = c.r;
+			level->camera.look_at.y = c.g;
+			level->camera.look_at.z = c.b;
+			settings |= SETTING_LOOK_AT;
+		} else if (sscanf(line, "size %u %u %u", &width, &height,
+				&layers) == 3) {
+			if (width == 0 || width > MAX_LEVEL_WIDTH
+					|| height == 0 || height > MAX_LEVEL_HEIGHT
+					|| layers == 0 || layers > MAX_LEVEL_LAYERS) {
+				fprintf(stderr, "%s:%u: size must be within %ux%ux%u\n",
+					path, line_num, MAX_LEVEL_WIDTH, MAX_LEVEL_HEIGHT,
+					MAX_LEVEL_LAYERS);
+				return 1;
+			}
+			settings |= SETTING_SIZE;
+		} else if (sscanf(line, "background %f %f %f", &c.r, &c.g,
+				&c.b) == 3) {
+			level->background_color = c;
+			settings |= SETTING_BACKGROUND;
+		} else if (sscanf(line, "player %f %f %f", &c.r, &c.g, &c.b) == 3) {
+			level->player_color = c;
+			settings |= SETTING_PLAYER;
+		} else if (sscanf(line, "goal %f %f %f", &c.r, &c.g, &c.b) == 3) {
+			level->goal_color = c;
+			settings |= SETTING_GOAL;
+		} else if (sscanf(line, "color %f %f %f %u", &c.r, &c.g, &c.b,
+				&h) == 4) {
+			if (num_colors == MAX_COLORS || h > 0xff) {
+				fprintf(stderr, "%s:%u: at most %u colours, with health "
+					"up to 255\n", path, line_num, MAX_COLORS);
+				return 1;
+			}
+			colors[num_colors] = c;
+			health[num_colors++] = h;
+			settings |= SETTING_COLOR;
+		} else {
+			fprintf(stderr, "%s:%u: unknown setting '%s'\n", path,
+				line_num, line);
+			return 1;
+		}
+	}
+	if (settings != SETTINGS_NEEDED) {
+		fprintf(stderr, "%s: needs camera, look_at, size, background, "
+			"player, goal and color before the map\n", path);
+		return 1;
+	}
+
+	u32 num_rows = 0, num_players = 0, num_blocks = 1;
+	while (*text) {
+		line = next_line(&text);
+		++line_num;
+		u32 len = strlen(line);
+		if (len == 0) {
+			continue;
+		}
+		if (num_rows == height * layers || len > width) {
+			fprintf(stderr, "%s:%u: the map is more than %u rows of %u\n",
+				path, line_num, height * layers, width);
+			return 1;
+		}
+		for (u32 x = 0; x < width; ++x) {
+			char cell = x < len ? line[x] : '.';
+			if (!strchr(".#123abc@!", cell)) {
+				fprintf(stderr, "%s:%u: unknown cell '%c'\n", path,
+					line_num, cell);
+				return 1;
+			}
+			if (color_of(cell) >= (i32)num_colors) {
+				fprintf(stderr, "%s:%u: '%c' needs colour %d\n", path,
+					line_num, cell, color_of(cell));
+				return 1;
+			}
+			num_players += cell == '@';
+			num_blocks += cell != '.';
+			rows[num_rows][x] = cell;
+		}
+		rows[num_rows++][width] = '\0';
+	}
+	if (num_rows != height * layers) {
+		fprintf(stderr, "%s: the map is %u rows, not %u\n", path,
+			num_rows, height * layers);
+		return 1;
+	}
+	if (num_players != 1) {
+		fprintf(stderr, "%s: needs exactly one player, not %u\n", path,
+			num_players);
+		return 1;
+	}
+	if (num_blocks > MAX_BLOCKS) {
+		fprintf(stderr, "%s: needs under %u blocks\n", path, MAX_BLOCKS);
+		return 1;
+	}
+
+	level->width  = width;
+	level->height = height;
+	level->layers = layers;
+	level->num_colors = num_colors;
+	for (u32 i = 0; i < num_colors; ++i) {
+		level->color_map[i]     = colors[i];
+		level->player_health[i] = health[i];
+	}
+	char *row_ptrs[MAX_ROWS];
+	for (u32 i = 0; i < num_rows; ++i) {
+		row_ptrs[i] = rows[i];
+	}
+	build_level_from_strings(level, row_ptrs);
+	return 0;
+}
+
+// Compiles the ASCII level files given into a level pack, in that order.
+i32 main(i32 argc, char *argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s out_pack level_file...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	i32 exit_status = EXIT_FAILURE;
+	u32 num_levels = argc - 2;
+	struct level *levels = malloc(num_levels * sizeof(struct level));
+	if (levels == NULL) {
+		fprintf(stderr, "out of memory\n");
+		goto error_alloc;
+	}
+	for (u32 i = 0; i < num_levels; ++i) {
+		const char *path = argv[i + 2];
+		struct mapped_file file;
+		if (map_file(path, &file)) {
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			goto error_parse;
+		}
+		char *text = malloc(file.size + 1);
+		if (text == NULL) {
+			fprintf(stderr, "out of memory\n");
+			unmap_file(&file);
+			goto error_parse;
+		}
+		if (file.size) {
+			memcpy(text, file.data, file.size);
+		}
+		text[file.size] = '\0';
+		unmap_file(&file);
+		reset_level(&levels[i]);
+		i32 failed = parse_level(path, text, &levels[i]);
+		free(text);
+		if (failed) {
+			goto error_parse;
+		}
+	}
+	FILE *out_file = fopen(argv[1], "wb");
+	if (out_file == NULL) {
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+		goto error_parse;
+	}
+	if (write_level_pack(out_file, levels, num_levels)) {
+		fprintf(stderr, "%s: write failed\n", argv[1]);
+		fclose(out_file);
+		remove(argv[1]);
+		goto error_parse;
+	}
+	if (fclose(out_file)) {
+		fprintf(stderr, "%s: write failed\n", argv[1]);
+		remove(argv[1]);
+		goto error_parse;
+	}
+	exit_status = EXIT_SUCCESS;
+error_parse:
+	free(levels);
+error_alloc:
+	return exit_status;
+}
@@ -0,0 +1,311 @@
+#include "program_cache.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytes.h"
+#include "files.h"
+
+// A binary is only any use to the driver that wrote it, so the file is in
+// the host's byte order: a header, then each program's entry header followed
+// by length bytes of binary.
+#define PROGRAM_CACHE_VERSION 1
+#define MAX_CACHED_PROGRAMS   16
+
+static const char program_cache_magic[8] = "LD44PRGM";
+
+struct cache_header {
+	char magic[8];
+	u32 version;
+	u32 num_programs;
+	u64 driver;
+};
+
+struct cache_entry {
+	u64 key;
+	u32 format;
+	u32 length;
+};
+
+struct cached_program {
+	struct cache_entry entry;
+	// Into the mapped file, or binary_owned for programs saved this run.
+	const void *binary;
+	void *binary_owned;
+	// Loaded or saved this run. Only these are written back, so entries
+	// for old shader sources don't fill the cache.
+	i32 used;
+};
+
+static i32 cache_enabled;
+static i32 cache_dirty;
+static char *cache_path;
+static u64 driver_hash;
+static struct mapped_file cache_file;
+static u32 num_cached_programs;
+static struct cached_program cached_programs[MAX_CACHED_PROGRAMS];
+
+static u64 fnv64(u64 hash, const void *data, u64 size) {
+	const u8 *bytes = data;
+	for (u64 i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * FNV_PRIME_64;
+	}
+	return hash;
+}
+
+// Hashes the terminator too, so moving text between strings changes it.
+static u64 fnv64_string(u64 hash, const char *s) {
+	return fnv64(hash, s, s ? strlen(s) + 1 : 0);
+}
+
+static u64 source_hash(const GLchar *vert_src, const GLchar *frag_src) {
+	return fnv64_string(fnv64_string(FNV_OFFSET_64, vert_src), frag_src);
+}
+
+static struct cached_program *find_cached_program(u64 key) {
+	for (u32 i = 0; i < num_cached_programs; ++i) {
+		if (cached_programs[i].entry.key == key) {
+			return &cached_programs[i];
+		}
+	}
+	return NULL;
+}
+
+static void drop_cached_program(struct cached_program *program) {
+	free(program->binary_owned);
+	*program = cached_programs[--num_cached_programs];
+	cache_dirty = 1;
+}
+
+static struct cached_program *find_unused_program(void) {
+	for (u32 i = 0; i < num_cached_programs; ++i) {
+		if (!cached_programs[i].used) {
+			return &cached_programs[i];
+		}
+	}
+	return NULL;
+}
+
+static void read_program_cache(void) {
+	if (map_file(cache_path, &cache_file)) {
+		// Most likely the first run.
+		return;
+	}
+	struct cache_header header;
+	if (cache_file.size < sizeof(header)) {
+		goto error_stale;
+	}
+	memcpy(&header, cache_file.data, sizeof(header));
+	if (memcmp(header.magic, program_cache_magic, sizeof(header.magic))
+			|| header.version != PROGRAM_CACHE_VERSION
+			|| header.driver != driver_hash) {
+		goto error_stale;
+	}
+	u64 offset = sizeof(header);
+	u32 count = MIN(header.num_programs, MAX_CACHED_PROGRAMS);
+	for (u32 i = 0; i < count; ++i) {
+		struct cached_program *program = &cached_programs[i];
+		if (cache_file.size - offset < sizeof(program->entry)) {
+			goto error_stale;
+		}
+		memcpy(&program->entry, cache_file.data + offset,
+			sizeof(program->entry));
+		offset += sizeof(program->entry);
+		if (cache_file.size - offset < program->entry.length) {
+			goto error_stale;
+		}
+		program->binary = cache_file.data + offset;
+		program->binary_owned = NULL;
+		program->used = 0;
+		offset += program->entry.length;
+		num_cached_programs = i + 1;
+	}
+	return;
+
+error_stale:
+	// Keep whatever was read whole; the rest is rebuilt and rewritten.
+	cache_dirty = 1;
+}
+
+void open_program_cache(void) {
+	if (!glGetProgramBinary || !glProgramBinary || !glProgramParameteri
+			|| !SDL_GL_ExtensionSupported("GL_ARB_get_program_binary")) {
+		return;
+	}
+	GLint num_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	if (num_formats <= 0) {
+		return;
+	}
+	char *pref_path = SDL_GetPrefPath("ld44", "ld44");
+	if (pref_path == NULL) {
+		return;
+	}
+	const char *filename = "programs.bin";
+	cache_path = malloc(strlen(pref_path) + strlen(filename) + 1);
+	if (cache_path == NULL) {
+		goto error_path;
+	}
+	strcpy(cache_path, pref_path);
+	strcat(cache_path, filename);
+
+	driver_hash = FNV_OFFSET_64;
+	driver_hash = fnv64_string(driver_hash,
+		(const char *)glGetString(GL_VENDOR));
+	driver_hash = fnv64_string(driver_hash,
+		(const char *)glGetString(GL_RENDERER));
+	driver_hash = fnv64_string(driver_hash,
+		(const char *)glGetString(GL_VERSION));
+	cache_enabled = 1;
+	read_program_cache();
+error_path:
+	SDL_free(pref_path);
+}
+
+static i32 write_program_cache(void) {
+	i32 result = 1;
+	u32 len = strlen(cache_path) + 5;
+	char *tmp_path = malloc(len);
+	if (tmp_path == NULL) {
+		goto error_tmp_path;
+	}
+	strcpy(tmp_path, cache_path);
+	strcat(tmp_path, ".tmp");
+	FILE *file = fopen(tmp_path, "wb");
+	if (file == NULL) {
+		goto error_open;
+	}
+	struct cache_header header;
+	memcpy(header.magic, program_cache_magic, sizeof(header.magic));
+	header.version      = PROGRAM_CACHE_VERSION;
+	header.num_programs = num_cached_programs;
+	header.driver       = driver_hash;
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		goto error_write;
+	}
+	for (u32 i = 0; i < num_cached_programs; ++i) {
+		struct cached_program *program = &cached_programs[i];
+		if (fwrite(&program->entry, sizeof(program->entry), 1, file) != 1
+				|| fwrite(program->binary, program->entry.length, 1,
+					file) != 1) {
+			goto error_write;
+		}
+	}
+	if (fclose(file)) {
+		file = NULL;
+		goto error_write;
+	}
+	file = NULL;
+	// Replacing the old file leaves its mapping intact until unmapped.
+	if (rename(tmp_path, cache_path)) {
+		goto error_write;
+	}
+	result = 0;
+error_write:
+	if (file) {
+		fclose(file);
+	}
+	if (result) {
+		remove(tmp_path);
+	}
+error_open:
+	free(tmp_path);
+error_tmp_path:
+	return result;
+}
+
+void close_program_cache(void) {
+	struct cached_program *unused;
+	while ((unused = find_unused_program())) {
+		drop_cached_program(unused);
+	}
+	if (cache_enabled && cache_dirty && write_program_cache()) {
+		SDL_Log("Unable to write the program cache '%s'", cache_path);
+	}
+	for (u32 i = 0; i < num_cached_programs; ++i) {
+		free(cached_programs[i].binary_owned);
+	}
+	num_cached_programs = 0;
+	unmap_file(&cache_file);
+	free(cache_path);
+	cache_path = NULL;
+	cache_enabled = 0;
+	cache_dirty = 0;
+}
+
+GLuint load_cached_program(const GLchar *vert_src, const GLchar *frag_src) {
+	if (!cache_enabled) {
+		return 0;
+	}
+	struct cached_program *cached =
+		find_cached_program(source_hash(vert_src, frag_src));
+	if (cached == NULL) {
+		return 0;
+	}
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, cached->entry.format, cached->binary,
+		cached->entry.length);
+	GLint link_status;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+	if (link_status == GL_FALSE) {
+		// Drivers may reject binaries for any reason, updates included.
+		glDeleteProgram(program);
+		drop_cached_program(cached);
+		return 0;
+	}
+	cached->used = 1;
+	return program;
+}
+
+void hint_program_retrievable(GLuint program) {
+	if (cache_enabled) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+			GL_TRUE);
+	}
+}
+
+void save_cached_program(GLuint program, const GLchar *vert_src,
+		const GLchar *frag_src) {
+	if (!cache_enabled) {
+		return;
+	}
+	u64 key = source_hash(vert_src, frag_src);
+	struct cached_program *cached = find_cached_program(key);
+	if (cached) {
+		drop_cached_program(cached);
+	}
+	if (num_cached_programs == MAX_CACHED_PROGRAMS) {
+		// Make room by dropping a program this run hasn't asked for.
+		struct cached_program *unused = find_unused_program();
+		if (unused == NULL) {
+			SDL_Log("Program cache full, not saving program");
+			return;
+		}
+		drop_cached_program(unused);
+	}
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	void *binary = malloc(length);
+	if (binary == NULL) {
+		return;
+	}
+	GLenum format;
+	glGetProgramBinary(program, length, &length, &format, binary);
+	if (length <= 0) {
+		free(binary);
+		return;
+	}
+	cached = &cached_programs[num_cached_programs++];
+	cached->entry.key    = key;
+	cached->entry.format = format;
+	cached->entry.length = length;
+	cached->binary       = binary;
+	cached->binary_owned = binary;
+	cached->used         = 1;
+	cache_dirty = 1;
+}
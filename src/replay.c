@@ -0,0 +1,247 @@
+#include "replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytes.h"
+
+static const u8 replay_magic[4] = { 'L', 'D', '4', '4' };
+
+static struct event events[MAX_EVENTS];
+
+static u64 fnv64_u32(u64 hash, u32 x) {
+	for (u32 i = 0; i < 4; ++i) {
+		hash = (hash ^ ((x >> (i * 8)) & 0xff)) * FNV_PRIME_64;
+	}
+	return hash;
+}
+
+static u64 fnv64_f32(u64 hash, f32 x) {
+	u32 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return fnv64_u32(hash, bits);
+}
+
+u32 events_result(struct event *events, u32 num_events) {
+	u32 result = 0;
+	for (u32 i = 0; i < num_events; ++i) {
+		switch (events[i].type) {
+		case EVENT_TYPE_MOVE:
+		case EVENT_TYPE_FALL:
+			result |= MOVE_RESULT_MOVED;
+			break;
+		case EVENT_TYPE_WIN:
+			result |= MOVE_RESULT_WON;
+			break;
+		case EVENT_TYPE_DEATH:
+			result |= MOVE_RESULT_DIED;
+			break;
+		case EVENT_TYPE_LOSE_HEALTH:
+		case EVENT_TYPE_GAIN_HEALTH:
+			result |= MOVE_RESULT_HEALTH_CHANGED;
+			break;
+		default:
+			break;
+		}
+	}
+	return result;
+}
+
+// Hashes the fields each event type uses, one byte at a time, so the hash
+// doesn't depend on padding or on the host's byte order.
+u64 hash_events(u64 hash, struct event *events, u32 num_events) {
+	for (u32 i = 0; i < num_events; ++i) {
+		struct event *e = &events[i];
+		hash = fnv64_u32(hash, e->type);
+		hash = fnv64_u32(hash, e->block_id);
+		hash = fnv64_f32(hash, e->start_time);
+		hash = fnv64_f32(hash, e->duration);
+		switch (e->type) {
+		case EVENT_TYPE_BOUNCE:
+			hash = fnv64_u32(hash, (u8)e->bounce.dx
+				| ((u8)e->bounce.dy << 8)
+				| ((u8)e->bounce.dz << 16));
+			break;
+		case EVENT_TYPE_MOVE:
+			hash = fnv64_u32(hash, e->move.is_player
+				| ((u8)e->move.x << 8)
+				| ((u8)e->move.y << 16)
+				| ((u32)(u8)e->move.z << 24));
+			break;
+		case EVENT_TYPE_FALL:
+			hash = fnv64_u32(hash, (u8)e->fall.x
+				| ((u8)e->fall.y << 8)
+				| ((u8)e->fall.z << 16));
+			break;
+		case EVENT_TYPE_COLLECTED:
+			hash = fnv64_u32(hash, e->collect.block_type);
+			break;
+		case EVENT_TYPE_LOSE_HEALTH:
+			hash = fnv64_u32(hash, e->lose_health.color
+				| (e->lose_health.amount << 8)
+				| (e->lose_health.new_amount << 16));
+			break;
+		case EVENT_TYPE_GAIN_HEALTH:
+			hash = fnv64_u32(hash, e->gain_health.color
+				| (e->gain_health.amount << 8)
+				| (e->gain_health.new_amount << 16));
+			break;
+		case EVENT_TYPE_WIN:
+		case EVENT_TYPE_DEATH:
+			break;
+		}
+	}
+	return hash;
+}
+
+void init_replay(struct replay *replay, u32 level, u32 seed) {
+	replay->level      = level;
+	replay->seed       = seed;
+	replay->num_moves  = 0;
+	replay->cap_moves  = 0;
+	replay->moves      = NULL;
+	replay->event_hash = FNV_OFFSET_64;
+	replay->result     = 0;
+}
+
+void free_replay(struct replay *replay) {
+	free(replay->moves);
+	replay->moves = NULL;
+	replay->num_moves = replay->cap_moves = 0;
+}
+
+static i32 reserve_moves(struct replay *replay, u32 num_moves) {
+	if (num_moves <= replay->cap_moves) {
+		return 0;
+	}
+	u32 new_cap = MAX(replay->cap_moves * 2, MAX(num_moves, 256));
+	u8 *moves = realloc(replay->moves, (new_cap + 3) / 4);
+	if (moves == NULL) {
+		return 1;
+	}
+	replay->moves = moves;
+	replay->cap_moves = new_cap;
+	return 0;
+}
+
+i32 record_move(struct replay *replay, enum move move,
+		struct event *events, u32 num_events) {
+	if (move == MOVE_NONE) {
+		return 0;
+	}
+	if (reserve_moves(replay, replay->num_moves + 1)) {
+		return 1;
+	}
+	u32 i = replay->num_moves++;
+	u8 *byte = &replay->moves[i / 4];
+	u32 shift = (i % 4) * 2;
+	if (shift == 0) {
+		*byte = 0;
+	}
+	*byte |= (move - MOVE_UP) << shift;
+	replay->event_hash = hash_events(replay->event_hash,
+		events, num_events);
+	replay->result |= events_result(events, num_events);
+	return 0;
+}
+
+enum move get_replay_move(struct replay *replay, u32 i) {
+	return MOVE_UP + ((replay->moves[i / 4] >> ((i % 4) * 2)) & 3);
+}
+
+static u32 replay_checksum(const u8 *header, const u8 *moves,
+		u32 num_moves) {
+	u32 hash = fnv32(FNV_OFFSET_32, header, REPLAY_HEADER_SIZE - 4);
+	return fnv32(hash, moves, (num_moves + 3) / 4);
+}
+
+i32 write_replay(FILE *file, struct replay *replay) {
+	u8 header[REPLAY_HEADER_SIZE] = { 0 };
+	memcpy(header, replay_magic, sizeof(replay_magic));
+	put_u16(header + 4,  REPLAY_VERSION);
+	put_u16(header + 6,  replay->level);
+	put_u32(header + 8,  replay->seed);
+	put_u32(header + 12, replay->num_moves);
+	put_u64(header + 16, replay->event_hash);
+	header[24] = replay->result;
+	put_u32(header + 28,
+		replay_checksum(header, replay->moves, replay->num_moves));
+	u64 moves_size = (replay->num_moves + 3) / 4;
+	if (fwrite(header, sizeof(header), 1, file) != 1) {
+		return 1;
+	}
+	if (moves_size
+			&& fwrite(replay->moves, moves_size, 1, file) != 1) {
+		return 1;
+	}
+	return 0;
+}
+
+enum replay_error read_replay(const u8 *data, u64 size, u64 *offset,
+		struct replay *replay) {
+	if (*offset == size) {
+		return REPLAY_END;
+	}
+	if (size - *offset < REPLAY_HEADER_SIZE) {
+		return REPLAY_TRUNCATED;
+	}
+	const u8 *header = data + *offset;
+	if (memcmp(header, replay_magic, sizeof(replay_magic)) != 0) {
+		return REPLAY_BAD_MAGIC;
+	}
+	if (get_u16(header + 4) != REPLAY_VERSION) {
+		return REPLAY_BAD_VERSION;
+	}
+	u32 num_moves = get_u32(header + 12);
+	u64 moves_size = ((u64)num_moves + 3) / 4;
+	if (size - *offset - REPLAY_HEADER_SIZE < moves_size) {
+		return REPLAY_TRUNCATED;
+	}
+	const u8 *moves = header + REPLAY_HEADER_SIZE;
+	if (get_u32(header + 28)
+			!= replay_checksum(header, moves, num_moves)) {
+		return REPLAY_BAD_CHECKSUM;
+	}
+	replay->level      = get_u16(header + 6);
+	replay->seed       = get_u32(header + 8);
+	replay->event_hash = get_u64(header + 16);
+	replay->result     = header[24];
+	replay->num_moves  = 0;
+	if (reserve_moves(replay, num_moves)) {
+		return REPLAY_OUT_OF_MEMORY;
+	}
+	if (moves_size) {
+		memcpy(replay->moves, moves, moves_size);
+	}
+	replay->num_moves = num_moves;
+	*offset += REPLAY_HEADER_SIZE + moves_size;
+	return REPLAY_OK;
+}
+
+const char *replay_error_string(enum replay_error error) {
+	switch (error) {
+	case REPLAY_OK:            return "ok";
+	case REPLAY_END:           return "end of file";
+	case REPLAY_TRUNCATED:     return "truncated record";
+	case REPLAY_BAD_MAGIC:     return "not a replay record";
+	case REPLAY_BAD_VERSION:   return "unsupported version";
+	case REPLAY_BAD_CHECKSUM:  return "checksum mismatch";
+	case REPLAY_OUT_OF_MEMORY: return "out of memory";
+	}
+	return "unknown error";
+}
+
+i32 verify_replay(struct replay *replay, struct level *start,
+		struct level *scratch) {
+	u64 hash = FNV_OFFSET_64;
+	u32 result = 0;
+	copy_level(scratch, start);
+	for (u32 i = 0; i < replay->num_moves; ++i) {
+		u32 num_events = 0;
+		play_move(scratch, &num_events, events,
+			get_replay_move(replay, i));
+		hash = hash_events(hash, events, num_events);
+		result |= events_result(events, num_events);
+	}
+	return hash != replay->event_hash || result != replay->result;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "levels.h"
+#include "replay.h"
+
+static f64 wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+static u8 *read_file(const char *path, u64 *size_out) {
+	u8 *data = NULL;
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		goto error_open;
+	}
+	if (fseek(file, 0, SEEK_END)) {
+		goto error_seek;
+	}
+	long size = ftell(file);
+	if (size < 0 || fseek(file, 0, SEEK_SET)) {
+		goto error_seek;
+	}
+	data = malloc(size ? size : 1);
+	if (data == NULL) {
+		goto error_seek;
+	}
+	if (size && fread(data, size, 1, file) != 1) {
+		free(data);
+		data = NULL;
+		goto error_seek;
+	}
+	*size_out = size;
+error_seek:
+	fclose(file);
+error_open:
+	return data;
+}
+
+static struct level *levels;
+static u32 num_levels;
+static struct level scratch;
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-l pack] replay_file...\n"
+		"  -l  level pack, defaults to " DEFAULT_LEVEL_PACK "\n", name);
+}
+
+// Checks every replay in the files given on the command line against
+// play_move, building each level once up front.
+i32 main(i32 argc, char *argv[]) {
+	const char *pack_path = DEFAULT_LEVEL_PACK;
+	i32 opt;
+	while ((opt = getopt(argc, argv, "l:")) != -1) {
+		switch (opt) {
+		case 'l':
+			pack_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind == argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	enum level_pack_error error = open_levels(pack_path);
+	if (error != LEVEL_PACK_OK) {
+		fprintf(stderr, "%s: %s\n", pack_path,
+			level_pack_error_string(error));
+		return EXIT_FAILURE;
+	}
+	num_levels = num_pack_levels();
+	levels = malloc(MAX(num_levels, 1) * sizeof(struct level));
+	if (levels == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	for (u32 n = 0; n < num_levels; ++n) {
+		error = build_level(&levels[n], n);
+		if (error != LEVEL_PACK_OK) {
+			fprintf(stderr, "%s: level %u: %s\n", pack_path, n,
+				level_pack_error_string(error));
+			return EXIT_FAILURE;
+		}
+	}
+	close_levels();
+
+	u64 num_replays = 0, num_failed = 0, num_moves = 0;
+	struct replay replay;
+	init_replay(&replay, 0, 0);
+	f64 start = wall_time();
+	for (i32 i = optind; i < argc; ++i) {
+		u64 size, offset = 0;
+		u8 *data = read_file(argv[i], &size);
+		if (data == NULL) {
+			fprintf(stderr, "%s: can't read file\n", argv[i]);
+			++num_failed;
+			continue;
+		}
+		for (u32 n = 0;; ++n) {
+			enum replay_error error = read_replay(data, size, &offset,
+				&replay);
+			if (error == REPLAY_END) {
+				break;
+			}
+			++num_replays;
+			if (error != REPLAY_OK) {
+				fprintf(stderr, "%s: record %u: %s\n", argv[i], n,
+					replay_error_string(error));
+				++num_failed;
+				break;
+			}
+			num_moves += replay.num_moves;
+			if (replay.level >= num_levels) {
+				fprintf(stderr, "%s: record %u: no level %u\n",
+					argv[i], n, replay.level);
+				++num_failed;
+			} else if (verify_replay(&replay, &levels[replay.level],
+					&scratch)) {
+				fprintf(stderr, "%s: record %u: level %u, %u moves: "
+					"outcome or events differ\n", argv[i], n,
+					replay.level, replay.num_moves);
+				++num_failed;
+			}
+		}
+		free(data);
+	}
+	f64 elapsed = wall_time() - start;
+	free_replay(&replay);
+	free(levels);
+
+	f64 rate = elapsed > 0.0 ? 1.0 / elapsed : 0.0;
+	printf("%llu replays, %llu failed, %llu moves, %.0f replays/s, "
+		"%.0f moves/s\n",
+		(unsigned long long)num_replays,
+		(unsigned long long)num_failed,
+		(unsigned long long)num_moves,
+		(f64)num_replays * rate, (f64)num_moves * rate);
+	return num_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
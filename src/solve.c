@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "levels.h"
+#include "solver.h"
+
+// Roughly 1.7 GiB of search state at the limit.
+#define DEFAULT_MAX_STATES 20000000
+
+static f64 wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+static char move_char(enum move move) {
+	switch (move) {
+	case MOVE_NONE:  return '.';
+	case MOVE_UP:    return 'U';
+	case MOVE_DOWN:  return 'D';
+	case MOVE_LEFT:  return 'L';
+	case MOVE_RIGHT: return 'R';
+	}
+	return '?';
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-j threads] [-n max_states] [-l pack] "
+		"[level]\n"
+		"  -j  search threads, defaults to one per core\n"
+		"  -n  give up after this many states, 0 for no limit\n"
+		"  -l  level pack, defaults to " DEFAULT_LEVEL_PACK "\n", name);
+}
+
+static struct level level;
+static struct solution solution;
+
+// Solves every level in the pack, or just the one given on the command
+// line, and prints the shortest solution for each.
+i32 main(i32 argc, char *argv[]) {
+	i32 exit_code = EXIT_SUCCESS;
+	u32 first = 0, last = ~0u, max_states = DEFAULT_MAX_STATES;
+	i64 num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+	u32 num_threads = num_cores > 0 ? num_cores : 1;
+	const char *pack_path = DEFAULT_LEVEL_PACK;
+	i32 opt;
+	while ((opt = getopt(argc, argv, "j:n:l:")) != -1) {
+		switch (opt) {
+		case 'j':
+			num_threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			max_states = strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			pack_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind < argc) {
+		first = last = strtoul(argv[optind], NULL, 10);
+	}
+	enum level_pack_error error = open_levels(pack_path);
+	if (error != LEVEL_PACK_OK) {
+		fprintf(stderr, "%s: %s\n", pack_path,
+			level_pack_error_string(error));
+		return EXIT_FAILURE;
+	}
+	for (u32 n = first; n <= last && n < num_pack_levels(); ++n) {
+		error = build_level(&level, n);
+		if (error != LEVEL_PACK_OK) {
+			printf("level %u: %s\n", n, level_pack_error_string(error));
+			exit_code = EXIT_FAILURE;
+			continue;
+		}
+		struct solve_stats stats;
+		f64 start = wall_time();
+		enum solve_result result = solve_level(&level, num_threads,
+			max_states, &solution, &stats);
+		f64 elapsed = wall_time() - start;
+		printf("level %u: ", n);
+		switch (result) {
+		case SOLVE_FOUND:
+			printf("%u moves ", solution.num_moves);
+			for (u32 i = 0; i < solution.num_moves; ++i) {
+				putchar(move_char(solution.moves[i]));
+			}
+			break;
+		case SOLVE_NO_SOLUTION:
+			printf("no solution");
+			exit_code = EXIT_FAILURE;
+			break;
+		case SOLVE_OUT_OF_MEMORY:
+			printf("out of memory");
+			exit_code = EXIT_FAILURE;
+			break;
+		case SOLVE_STATE_LIMIT:
+			printf("gave up after %u states", max_states);
+			exit_code = EXIT_FAILURE;
+			break;
+		}
+		f64 rate = elapsed > 0.0 ? 1.0 / elapsed : 0.0;
+		printf("\n  %llu nodes, %llu states, %.0f nodes/s, "
+			"%.1f KiB peak, %.3fs\n",
+			(unsigned long long)stats.nodes_expanded,
+			(unsigned long long)stats.states_seen,
+			(f64)stats.nodes_expanded * rate,
+			(f64)stats.peak_bytes / 1024.0, elapsed);
+		if (stats.num_threads > 1) {
+			for (u32 i = 0; i < stats.num_threads; ++i) {
+				struct solve_thread_stats *ts = &stats.threads[i];
+				printf("  thread %u: %llu nodes, %.0f nodes/s, "
+					"%llu steals\n", i,
+					(unsigned long long)ts->nodes_expanded,
+					(f64)ts->nodes_expanded * rate,
+					(unsigned long long)ts->steals);
+			}
+		}
+	}
+	close_levels();
+	return exit_code;
+}
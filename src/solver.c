@@ -0,0 +1,793 @@
+#include "solver.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Key position of blocks that have been collected.
+#define POS_GONE 0x7f
+
+// Zobrist keys cover the level plus this many cells either side of it in x
+// and z, which is as far as pushed cubes get in practice. Positions past
+// that are hashed by mixing their coordinates instead.
+#define ZOBRIST_MARGIN 2
+
+// Bound on g + h: g is capped at MAX_SOLUTION_MOVES and h is a distance
+// between two i8 positions.
+#define MAX_SEARCH_COST (MAX_SOLUTION_MOVES + 512)
+
+// Nodes and their keys are allocated in chunks that never move, so threads
+// can read them while others are adding more.
+#define NODE_CHUNK_BITS 16
+#define NODE_CHUNK      (1u << NODE_CHUNK_BITS)
+#define MAX_NODE_CHUNKS (1u << 15)
+
+// The transposition table is split into shards, picked by the top bits of
+// the hash, each behind its own lock.
+#define SHARD_BITS 6
+#define NUM_SHARDS (1u << SHARD_BITS)
+#define INITIAL_SHARD_CAP (1 << 8)
+
+#define UNREACHABLE (~0u)
+#define NO_NODE     (~0u)
+
+// Search nodes only hold a key; the level itself is rebuilt from the root
+// level when the node is expanded. Collecting swap-removes blocks, so the
+// order of the blocks depends on the order things were collected in, which
+// is recovered by walking the parent chain.
+struct node {
+	u32 parent;
+	u16 g;
+	u16 collected_id;
+	u8 move;
+};
+
+struct table_entry {
+	u64 hash;
+	u32 node_plus_one;
+};
+
+struct shard {
+	pthread_mutex_t lock;
+	struct table_entry *table;
+	u32 cap, count;
+};
+
+// A thread's queue of nodes with one value of f. The queue for the f being
+// searched is also the thread's work-stealing deque: the owner pushes and
+// pops at the back, other threads steal from the front.
+struct bucket {
+	u32 *nodes;
+	u32 head, num_nodes, cap_nodes;
+};
+
+struct search_thread {
+	struct solver *s;
+	u32 index;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	struct bucket buckets[MAX_SEARCH_COST];
+
+	struct level *cur, *next;
+	u8 *key;
+	u16 collected[MAX_BLOCKS];
+
+	u32 best_cost, best_node;
+	enum move best_move;
+
+	struct solve_thread_stats stats;
+};
+
+struct solver {
+	struct level *root;
+
+	// States are keyed on every block that can move or be collected, plus
+	// the player's health. Grey cubes never change so are left out.
+	// Coloured cubes of the same colour are interchangeable, so they are
+	// grouped by colour at the end of dynamic_ids and their positions are
+	// sorted within each group.
+	u32 num_dynamic;
+	u16 dynamic_ids[MAX_BLOCKS];
+	struct {
+		u32 start, count;
+	} cube_groups[MAX_COLORS];
+	u32 player_index;
+	u32 num_colors;
+	u32 key_size;
+
+	u32 num_goals;
+	struct {
+		i8 x, y, z;
+	} goals[MAX_BLOCKS];
+
+	i32 box_x0, box_z0;
+	u32 box_width, box_height, box_layers, box_cells;
+	u64 *zobrist_pos;
+	u64 zobrist_health[MAX_COLORS][256];
+
+	// Each chunk is NODE_CHUNK nodes followed by their keys.
+	struct node *node_chunks[MAX_NODE_CHUNKS];
+	u32 num_nodes, max_states;
+	pthread_mutex_t chunk_lock;
+
+	struct shard shards[NUM_SHARDS];
+
+	struct search_thread *threads;
+	u32 num_threads, cap_threads;
+
+	// The f being searched, and how many nodes with that f are queued or
+	// being expanded. Threads only move on to the next f together.
+	u32 f, pending, done;
+	u32 best_cost, best_node;
+	enum move best_move;
+
+	// Guards everything below.
+	pthread_mutex_t lock;
+	pthread_cond_t barrier_cond;
+	u32 barrier_waiting, barrier_generation;
+	u32 stop;
+	enum solve_result stop_reason;
+	u64 bytes, peak_bytes;
+};
+
+static u64 splitmix64(u64 *state) {
+	u64 z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static void stop_search(struct solver *s, enum solve_result reason) {
+	pthread_mutex_lock(&s->lock);
+	if (!s->stop) {
+		s->stop_reason = reason;
+		__atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void *solver_realloc(struct solver *s, void *ptr,
+		u64 old_size, u64 new_size) {
+	void *result = realloc(ptr, new_size);
+	if (result == NULL) {
+		stop_search(s, SOLVE_OUT_OF_MEMORY);
+		return NULL;
+	}
+	pthread_mutex_lock(&s->lock);
+	s->bytes = s->bytes - old_size + new_size;
+	s->peak_bytes = MAX(s->peak_bytes, s->bytes);
+	pthread_mutex_unlock(&s->lock);
+	return result;
+}
+
+static void solver_free(struct solver *s, void *ptr, u64 size) {
+	free(ptr);
+	pthread_mutex_lock(&s->lock);
+	s->bytes -= size;
+	pthread_mutex_unlock(&s->lock);
+}
+
+// Blocks until every search thread has called it.
+static void barrier_wait(struct solver *s) {
+	pthread_mutex_lock(&s->lock);
+	u32 generation = s->barrier_generation;
+	if (++s->barrier_waiting == s->num_threads) {
+		s->barrier_waiting = 0;
+		++s->barrier_generation;
+		pthread_cond_broadcast(&s->barrier_cond);
+	} else {
+		while (generation == s->barrier_generation) {
+			pthread_cond_wait(&s->barrier_cond, &s->lock);
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+static i32 init_solver(struct solver *s, struct level *level,
+		u32 num_threads, u32 max_states) {
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_mutex_init(&s->chunk_lock, NULL);
+	pthread_cond_init(&s->barrier_cond, NULL);
+	for (u32 i = 0; i < NUM_SHARDS; ++i) {
+		pthread_mutex_init(&s->shards[i].lock, NULL);
+	}
+	s->max_states = max_states;
+	s->best_cost = ~0u;
+
+	s->num_dynamic = 0;
+	s->num_goals = 0;
+	for (u32 i = 1; i < level->num_blocks; ++i) {
+		struct block *b = &level->blocks[i];
+		if (b->type == BLOCK_TYPE_CUBE) {
+			continue;
+		}
+		if (b->type == BLOCK_TYPE_PLAYER) {
+			s->player_index = s->num_dynamic;
+		}
+		if (b->type == BLOCK_TYPE_GOAL) {
+			s->goals[s->num_goals].x = b->pos.x;
+			s->goals[s->num_goals].y = b->pos.y;
+			s->goals[s->num_goals].z = b->pos.z;
+			++s->num_goals;
+		}
+		s->dynamic_ids[s->num_dynamic++] = b->block_id;
+	}
+	for (u32 color = 1; color < MAX_COLORS; ++color) {
+		s->cube_groups[color].start = s->num_dynamic;
+		for (u32 i = 1; i < level->num_blocks; ++i) {
+			struct block *b = &level->blocks[i];
+			if (b->type == BLOCK_TYPE_CUBE && b->cube.color == color) {
+				s->dynamic_ids[s->num_dynamic++] = b->block_id;
+			}
+		}
+		s->cube_groups[color].count
+			= s->num_dynamic - s->cube_groups[color].start;
+	}
+	s->num_colors = level->num_colors;
+	s->key_size = s->num_dynamic * 3 + s->num_colors;
+
+	s->box_x0     = -ZOBRIST_MARGIN;
+	s->box_z0     = -ZOBRIST_MARGIN;
+	s->box_width  = level->width  + 2 * ZOBRIST_MARGIN;
+	s->box_height = level->height + 2 * ZOBRIST_MARGIN;
+	s->box_layers = level->layers;
+	s->box_cells  = s->box_width * s->box_height * s->box_layers;
+
+	u64 rng = 0x1d44;
+	u64 num_zobrist = (u64)s->num_dynamic * (s->box_cells + 1);
+	s->zobrist_pos = solver_realloc(s, NULL, 0,
+		num_zobrist * sizeof(u64));
+	if (s->zobrist_pos == NULL) {
+		return 1;
+	}
+	for (u64 i = 0; i < num_zobrist; ++i) {
+		s->zobrist_pos[i] = splitmix64(&rng);
+	}
+	for (u32 i = 0; i < MAX_COLORS; ++i) {
+		for (u32 j = 0; j < 256; ++j) {
+			s->zobrist_health[i][j] = splitmix64(&rng);
+		}
+	}
+
+	for (u32 i = 0; i < NUM_SHARDS; ++i) {
+		struct shard *sh = &s->shards[i];
+		sh->cap = INITIAL_SHARD_CAP;
+		sh->table = solver_realloc(s, NULL, 0,
+			sh->cap * sizeof(struct table_entry));
+		if (sh->table == NULL) {
+			return 1;
+		}
+		memset(sh->table, 0, sh->cap * sizeof(struct table_entry));
+	}
+
+	s->root = solver_realloc(s, NULL, 0, sizeof(struct level));
+	s->threads = solver_realloc(s, NULL, 0,
+		num_threads * sizeof(struct search_thread));
+	if (s->root == NULL || s->threads == NULL) {
+		return 1;
+	}
+	memset(s->threads, 0, num_threads * sizeof(struct search_thread));
+	s->num_threads = s->cap_threads = num_threads;
+	for (u32 i = 0; i < num_threads; ++i) {
+		pthread_mutex_init(&s->threads[i].lock, NULL);
+	}
+	for (u32 i = 0; i < num_threads; ++i) {
+		struct search_thread *t = &s->threads[i];
+		t->s     = s;
+		t->index = i;
+		t->best_cost = ~0u;
+		t->cur  = solver_realloc(s, NULL, 0, sizeof(struct level));
+		t->next = solver_realloc(s, NULL, 0, sizeof(struct level));
+		t->key  = solver_realloc(s, NULL, 0, s->key_size);
+		if (t->cur == NULL || t->next == NULL || t->key == NULL) {
+			return 1;
+		}
+	}
+	copy_level(s->root, level);
+	return 0;
+}
+
+static void free_solver(struct solver *s) {
+	free(s->zobrist_pos);
+	for (u32 i = 0; i < MAX_NODE_CHUNKS; ++i) {
+		free(s->node_chunks[i]);
+	}
+	for (u32 i = 0; i < NUM_SHARDS; ++i) {
+		free(s->shards[i].table);
+		pthread_mutex_destroy(&s->shards[i].lock);
+	}
+	for (u32 i = 0; i < s->cap_threads; ++i) {
+		struct search_thread *t = &s->threads[i];
+		for (u32 j = 0; j < MAX_SEARCH_COST; ++j) {
+			free(t->buckets[j].nodes);
+		}
+		free(t->cur);
+		free(t->next);
+		free(t->key);
+		pthread_mutex_destroy(&t->lock);
+	}
+	free(s->threads);
+	free(s->root);
+	pthread_cond_destroy(&s->barrier_cond);
+	pthread_mutex_destroy(&s->chunk_lock);
+	pthread_mutex_destroy(&s->lock);
+}
+
+static inline struct node *get_node(struct solver *s, u32 node) {
+	return &s->node_chunks[node >> NODE_CHUNK_BITS][node & (NODE_CHUNK-1)];
+}
+
+static inline u8 *node_key(struct solver *s, u32 node) {
+	u8 *keys = (u8 *)(s->node_chunks[node >> NODE_CHUNK_BITS] + NODE_CHUNK);
+	return &keys[(u64)(node & (NODE_CHUNK-1)) * s->key_size];
+}
+
+// Reserves a node, allocating its chunk if it is the first one there.
+// Returns NO_NODE, having stopped the search, when out of states.
+static u32 alloc_node(struct solver *s) {
+	u32 node = __atomic_fetch_add(&s->num_nodes, 1, __ATOMIC_RELAXED);
+	if (s->max_states && node >= s->max_states) {
+		stop_search(s, SOLVE_STATE_LIMIT);
+		return NO_NODE;
+	}
+	u32 chunk = node >> NODE_CHUNK_BITS;
+	if (chunk >= MAX_NODE_CHUNKS) {
+		stop_search(s, SOLVE_OUT_OF_MEMORY);
+		return NO_NODE;
+	}
+	if (__atomic_load_n(&s->node_chunks[chunk], __ATOMIC_ACQUIRE) == NULL) {
+		pthread_mutex_lock(&s->chunk_lock);
+		if (s->node_chunks[chunk] == NULL) {
+			struct node *nodes = solver_realloc(s, NULL, 0,
+				NODE_CHUNK * (sizeof(struct node) + (u64)s->key_size));
+			__atomic_store_n(&s->node_chunks[chunk], nodes,
+				__ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&s->chunk_lock);
+		if (s->node_chunks[chunk] == NULL) {
+			return NO_NODE;
+		}
+	}
+	return node;
+}
+
+static i32 compare_pos(const void *a, const void *b) {
+	return memcmp(a, b, 3);
+}
+
+static void build_key(struct solver *s, struct level *level, u8 *key) {
+	u8 *k = key;
+	for (u32 i = 0; i < s->num_dynamic; ++i) {
+		u16 id = s->dynamic_ids[i];
+		u32 slot = level->block_slots[id];
+		struct block *b = &level->blocks[slot];
+		if (slot < level->num_blocks && b->block_id == id) {
+			*k++ = (u8)b->pos.x;
+			*k++ = (u8)b->pos.y;
+			*k++ = (u8)b->pos.z;
+		} else {
+			*k++ = POS_GONE;
+			*k++ = POS_GONE;
+			*k++ = POS_GONE;
+		}
+	}
+	for (u32 i = 0; i < s->num_colors; ++i) {
+		*k++ = level->player_health[i];
+	}
+	for (u32 color = 1; color < MAX_COLORS; ++color) {
+		if (s->cube_groups[color].count > 1) {
+			qsort(&key[s->cube_groups[color].start * 3],
+				s->cube_groups[color].count, 3, compare_pos);
+		}
+	}
+}
+
+static void decode_node(struct search_thread *t, u32 node,
+		struct level *level) {
+	struct solver *s = t->s;
+	u32 num_collected = 0;
+	for (u32 n = node; n; n = get_node(s, n)->parent) {
+		u16 id = get_node(s, n)->collected_id;
+		if (id) {
+			t->collected[num_collected++] = id;
+		}
+	}
+	copy_level(level, s->root);
+	while (num_collected--) {
+		delete_block_by_id(level, t->collected[num_collected]);
+	}
+	u8 *k = node_key(s, node);
+	for (u32 i = 0; i < s->num_dynamic; ++i, k += 3) {
+		if (k[0] != POS_GONE) {
+			move_block_by_id(level, s->dynamic_ids[i],
+				(i8)k[0], (i8)k[1], (i8)k[2]);
+		}
+	}
+	memcpy(level->player_health, k, s->num_colors);
+}
+
+// Distance in x and z from the player to the nearest goal. The player moves
+// at most one cell horizontally per move, so this never overestimates.
+// Nothing ever lifts the player, so goals above it are out of reach.
+static u32 heuristic(struct solver *s, u8 *key) {
+	u8 *player = &key[s->player_index * 3];
+	i32 x = (i8)player[0], y = (i8)player[1], z = (i8)player[2];
+	u32 best = UNREACHABLE;
+	for (u32 i = 0; i < s->num_goals; ++i) {
+		if (y < s->goals[i].y) {
+			continue;
+		}
+		u32 dist = abs(x - s->goals[i].x) + abs(z - s->goals[i].z);
+		best = MIN(best, dist);
+	}
+	return best;
+}
+
+static u64 hash_key(struct solver *s, u8 *key) {
+	u64 hash = 0;
+	u8 *k = key;
+	for (u32 i = 0; i < s->num_dynamic; ++i, k += 3) {
+		i32 x = (i8)k[0], y = (i8)k[1], z = (i8)k[2];
+		u32 cell = s->box_cells;
+		if (k[0] != POS_GONE) {
+			i32 bx = x - s->box_x0, bz = z - s->box_z0;
+			if (bx < 0 || bx >= (i32)s->box_width
+					|| y < 0 || y >= (i32)s->box_layers
+					|| bz < 0 || bz >= (i32)s->box_height) {
+				u64 state = ((u64)i << 24) | ((u64)k[0] << 16)
+					| ((u64)k[1] << 8) | k[2];
+				hash ^= splitmix64(&state);
+				continue;
+			}
+			cell = (y * s->box_height + bz) * s->box_width + bx;
+		}
+		hash ^= s->zobrist_pos[i * (s->box_cells + 1) + cell];
+	}
+	for (u32 i = 0; i < s->num_colors; ++i) {
+		hash ^= s->zobrist_health[i][*k++];
+	}
+	return hash;
+}
+
+static void table_put(struct table_entry *table, u32 cap,
+		u64 hash, u32 node) {
+	u32 i = hash & (cap - 1);
+	while (table[i].node_plus_one) {
+		i = (i + 1) & (cap - 1);
+	}
+	table[i].hash = hash;
+	table[i].node_plus_one = node + 1;
+}
+
+static i32 grow_shard(struct solver *s, struct shard *sh) {
+	u32 new_cap = sh->cap * 2;
+	struct table_entry *new_table = solver_realloc(s, NULL, 0,
+		new_cap * sizeof(struct table_entry));
+	if (new_table == NULL) {
+		return 1;
+	}
+	memset(new_table, 0, new_cap * sizeof(struct table_entry));
+	for (u32 i = 0; i < sh->cap; ++i) {
+		struct table_entry *e = &sh->table[i];
+		if (e->node_plus_one) {
+			table_put(new_table, new_cap, e->hash,
+				e->node_plus_one - 1);
+		}
+	}
+	solver_free(s, sh->table, sh->cap * sizeof(struct table_entry));
+	sh->table = new_table;
+	sh->cap = new_cap;
+	return 0;
+}
+
+static i32 bucket_push(struct solver *s, struct bucket *b, u32 node) {
+	if (b->num_nodes == b->cap_nodes) {
+		u32 new_cap = b->cap_nodes ? b->cap_nodes * 2 : 256;
+		u32 *nodes = solver_realloc(s, b->nodes,
+			(u64)b->cap_nodes * sizeof(u32),
+			(u64)new_cap * sizeof(u32));
+		if (nodes == NULL) {
+			return 1;
+		}
+		b->nodes = nodes;
+		b->cap_nodes = new_cap;
+	}
+	b->nodes[b->num_nodes++] = node;
+	return 0;
+}
+
+// Queues a node on the thread's own bucket for f. Nodes with the f being
+// searched go on the deque other threads steal from.
+static void push_node(struct search_thread *t, u32 node, u32 f) {
+	struct solver *s = t->s;
+	assert(f >= s->f && f < MAX_SEARCH_COST);
+	if (f != s->f) {
+		bucket_push(s, &t->buckets[f], node);
+		return;
+	}
+	__atomic_add_fetch(&s->pending, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&t->lock);
+	if (bucket_push(s, &t->buckets[f], node)) {
+		__atomic_sub_fetch(&s->pending, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&t->lock);
+}
+
+// Records the state in t->key as reached from parent. New states, and
+// known states reached in fewer moves than before, are queued for
+// expansion. Running out of memory or states stops the search.
+static void add_state(struct search_thread *t, u32 parent, u8 move, u16 g) {
+	struct solver *s = t->s;
+	u8 *key = t->key;
+	u32 h = heuristic(s, key);
+	if (h == UNREACHABLE) {
+		return;
+	}
+	u64 hash = hash_key(s, key);
+	struct shard *sh = &s->shards[hash >> (64 - SHARD_BITS)];
+	pthread_mutex_lock(&sh->lock);
+	u32 i = hash & (sh->cap - 1);
+	u32 node = NO_NODE;
+	while (sh->table[i].node_plus_one) {
+		struct table_entry *e = &sh->table[i];
+		if (e->hash == hash && memcmp(key,
+				node_key(s, e->node_plus_one - 1),
+				s->key_size) == 0) {
+			node = e->node_plus_one - 1;
+			break;
+		}
+		i = (i + 1) & (sh->cap - 1);
+	}
+	if (node == NO_NODE) {
+		node = alloc_node(s);
+		if (node == NO_NODE) {
+			pthread_mutex_unlock(&sh->lock);
+			return;
+		}
+		memcpy(node_key(s, node), key, s->key_size);
+		sh->table[i].hash = hash;
+		sh->table[i].node_plus_one = node + 1;
+		if (++sh->count * 2 > sh->cap) {
+			grow_shard(s, sh);
+		}
+	} else if (get_node(s, node)->g <= g) {
+		pthread_mutex_unlock(&sh->lock);
+		return;
+	}
+	struct node *n = get_node(s, node);
+	n->parent = parent;
+	n->g      = g;
+	n->move   = move;
+	n->collected_id = 0;
+	if (node) {
+		u8 *before = node_key(s, parent), *after = key;
+		for (u32 j = 0; j < s->num_dynamic; ++j) {
+			if (after[j*3] == POS_GONE && before[j*3] != POS_GONE) {
+				n->collected_id = s->dynamic_ids[j];
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&sh->lock);
+	push_node(t, node, g + h);
+}
+
+// The heuristic is consistent, so a node's g can no longer drop once its f
+// is being searched, and nodes are safe to read without the shard lock.
+static void expand_node(struct search_thread *t, u32 node) {
+	struct solver *s = t->s;
+	u16 g = get_node(s, node)->g;
+	if (g + heuristic(s, node_key(s, node)) != s->f) {
+		// Since re-queued with a lower g.
+		return;
+	}
+	decode_node(t, node, t->cur);
+	++t->stats.nodes_expanded;
+	for (u32 move = MOVE_UP; move <= MOVE_RIGHT; ++move) {
+		copy_level(t->next, t->cur);
+		u32 r = play_move_fast(t->next, move);
+		++t->stats.moves_played;
+		if (r & MOVE_RESULT_DIED) {
+			continue;
+		}
+		if (r & MOVE_RESULT_WON) {
+			if (g + 1u < t->best_cost) {
+				t->best_cost = g + 1;
+				t->best_node = node;
+				t->best_move = move;
+			}
+			continue;
+		}
+		if (g + 1 >= MAX_SOLUTION_MOVES) {
+			continue;
+		}
+		build_key(s, t->next, t->key);
+		add_state(t, node, move, g + 1);
+	}
+}
+
+static i32 pop_node(struct search_thread *t, u32 *node_out) {
+	struct bucket *b = &t->buckets[t->s->f];
+	i32 found = 0;
+	pthread_mutex_lock(&t->lock);
+	if (b->head < b->num_nodes) {
+		*node_out = b->nodes[--b->num_nodes];
+		found = 1;
+	}
+	pthread_mutex_unlock(&t->lock);
+	return found;
+}
+
+static i32 steal_node(struct search_thread *t, u32 *node_out) {
+	struct solver *s = t->s;
+	for (u32 i = 1; i < s->num_threads; ++i) {
+		struct search_thread *victim
+			= &s->threads[(t->index + i) % s->num_threads];
+		struct bucket *b = &victim->buckets[s->f];
+		i32 found = 0;
+		pthread_mutex_lock(&victim->lock);
+		if (b->head < b->num_nodes) {
+			*node_out = b->nodes[b->head++];
+			found = 1;
+		}
+		pthread_mutex_unlock(&victim->lock);
+		if (found) {
+			++t->stats.steals;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Expands nodes with the current f, from this thread's deque or stolen
+// from others, until there are none left anywhere.
+static void search_layer(struct search_thread *t) {
+	struct solver *s = t->s;
+	while (__atomic_load_n(&s->pending, __ATOMIC_ACQUIRE)
+			&& !__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+		u32 node;
+		if (pop_node(t, &node) || steal_node(t, &node)) {
+			expand_node(t, node);
+			__atomic_sub_fetch(&s->pending, 1, __ATOMIC_RELEASE);
+		} else {
+			sched_yield();
+		}
+	}
+}
+
+// Run by one thread while the others wait: finds the next f from f on with
+// nodes queued, or decides the search is over. A win found with cost
+// best_cost is optimal once every cheaper f is done.
+static void next_layer(struct solver *s, u32 f) {
+	for (u32 i = 0; i < s->num_threads; ++i) {
+		struct search_thread *t = &s->threads[i];
+		if (t->best_cost < s->best_cost) {
+			s->best_cost = t->best_cost;
+			s->best_node = t->best_node;
+			s->best_move = t->best_move;
+		}
+	}
+	for (; f < MAX_SEARCH_COST && f < s->best_cost && !s->stop; ++f) {
+		u32 pending = 0;
+		for (u32 i = 0; i < s->num_threads; ++i) {
+			pending += s->threads[i].buckets[f].num_nodes;
+		}
+		if (pending) {
+			s->f = f;
+			s->pending = pending;
+			return;
+		}
+	}
+	s->done = 1;
+}
+
+static void free_layer(struct search_thread *t) {
+	struct bucket *b = &t->buckets[t->s->f];
+	solver_free(t->s, b->nodes, (u64)b->cap_nodes * sizeof(u32));
+	b->nodes = NULL;
+	b->head = b->num_nodes = b->cap_nodes = 0;
+}
+
+static void run_search_thread(struct search_thread *t) {
+	struct solver *s = t->s;
+	barrier_wait(s);
+	while (!s->done) {
+		search_layer(t);
+		barrier_wait(s);
+		free_layer(t);
+		barrier_wait(s);
+		if (t->index == 0) {
+			next_layer(s, s->f + 1);
+		}
+		barrier_wait(s);
+	}
+}
+
+static void *search_thread_main(void *arg) {
+	run_search_thread(arg);
+	return NULL;
+}
+
+static void build_solution(struct solver *s, u32 node, enum move last_move,
+		struct solution *solution) {
+	u32 num_moves = get_node(s, node)->g + 1;
+	assert(num_moves <= MAX_SOLUTION_MOVES);
+	solution->num_moves = num_moves;
+	solution->moves[--num_moves] = last_move;
+	for (u32 n = node; n; n = get_node(s, n)->parent) {
+		solution->moves[--num_moves] = get_node(s, n)->move;
+	}
+}
+
+enum solve_result solve_level(
+		struct level *level,
+		u32 num_threads,
+		u32 max_states,
+		struct solution *solution_out,
+		struct solve_stats *stats_out) {
+	enum solve_result result = SOLVE_OUT_OF_MEMORY;
+	struct solve_stats stats = { 0 };
+	num_threads = MAX(1, MIN(num_threads, MAX_SOLVER_THREADS));
+	struct solver *s = calloc(1, sizeof(*s));
+	if (s == NULL) {
+		goto error_alloc_solver;
+	}
+	if (init_solver(s, level, num_threads, max_states)) {
+		goto done;
+	}
+
+	struct search_thread *t = &s->threads[0];
+	build_key(s, level, t->key);
+	s->f = heuristic(s, t->key);
+	add_state(t, 0, MOVE_NONE, 0);
+	next_layer(s, 0);
+
+	// Thread 0 is the calling thread. If a thread can't be started, search
+	// with the ones that could.
+	u32 started = 1;
+	while (started < num_threads && pthread_create(
+			&s->threads[started].thread, NULL, search_thread_main,
+			&s->threads[started]) == 0) {
+		++started;
+	}
+	pthread_mutex_lock(&s->lock);
+	s->num_threads = started;
+	pthread_mutex_unlock(&s->lock);
+	run_search_thread(t);
+	for (u32 i = 1; i < started; ++i) {
+		pthread_join(s->threads[i].thread, NULL);
+	}
+
+	if (s->stop) {
+		result = s->stop_reason;
+	} else if (s->best_cost != ~0u) {
+		build_solution(s, s->best_node, s->best_move, solution_out);
+		result = SOLVE_FOUND;
+	} else {
+		result = SOLVE_NO_SOLUTION;
+	}
+
+done:
+	stats.num_threads = s->num_threads;
+	for (u32 i = 0; i < s->num_threads; ++i) {
+		struct solve_thread_stats *ts = &s->threads[i].stats;
+		stats.threads[i] = *ts;
+		stats.nodes_expanded += ts->nodes_expanded;
+		stats.moves_played   += ts->moves_played;
+		stats.steals         += ts->steals;
+	}
+	stats.states_seen = s->num_nodes;
+	if (s->max_states) {
+		stats.states_seen = MIN(stats.states_seen, s->max_states);
+	}
+	stats.peak_bytes = s->peak_bytes + sizeof(*s);
+	free_solver(s);
+	free(s);
+error_alloc_solver:
+	if (stats_out) {
+		*stats_out = stats;
+	}
+	return result;
+}